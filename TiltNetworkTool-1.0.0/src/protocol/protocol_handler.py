@@ -1,5 +1,6 @@
-from typing import List, Dict, Any
+from typing import List, Dict, Any, Optional
 import logging
+import struct
 
 class ProtocolHandler:
     """
@@ -10,14 +11,49 @@ class ProtocolHandler:
         validar y convertir a una estructura uniforme para la GUI según lo especificado.
       - Construcción de mensajes salientes en build_led_command().
     """
+    # Formato de frame (antes de COBS), ver source/app/Telemetry.h en el firmware:
+    #   [0]    header: estación (bits 0-3), valores float (bit 4), roll/pitch/yaw presentes (bits 5-7)
+    #   [1]    número de secuencia
+    #   [2..]  un valor por ángulo presente, en orden roll, pitch, yaw. int16 little endian en
+    #          centésimas de grado, o float32 little endian si el bit 4 está activo
+    #   [n..]  CRC-16/CCITT-FALSE de todo lo anterior, little endian
+    # El frame completo va codificado en COBS y terminado en 0x00, así que ante un error
+    # alcanza con descartar hasta el próximo 0x00 para resincronizar.
+    DELIMITER = 0x00
+    FORMAT_FLOAT = 0x10
+    MAX_BUFFER_SIZE = 1024
+
     def __init__(self) -> None:
         # Buffer/s, constantes, ...        
         logging.info("[ProtocolHandler] Inicializado. Listo para recibir bytes del puerto serie.")
-        self.buffer = str()
-        self.frame_start = False
-        self.current_station_index = None
-        self.current_data_prefix = None
-        self.current_data_value = None
+        self.buffer = bytearray()
+        self.last_sequence = {}
+        self.crc_errors = 0
+        self.lost_frames = 0
+
+    @staticmethod
+    def crc16(data: bytes) -> int:
+        crc = 0xFFFF
+        for byte in data:
+            crc ^= byte << 8
+            for _ in range(8):
+                crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+                crc &= 0xFFFF
+        return crc
+
+    @staticmethod
+    def cobs_decode(data: bytes) -> Optional[bytes]:
+        output = bytearray()
+        index = 0
+        while index < len(data):
+            code = data[index]
+            if code == 0 or index + code > len(data):
+                return None
+            output += data[index + 1:index + code]
+            index += code
+            if code != 0xFF and index < len(data):
+                output.append(0)
+        return bytes(output)
 
     def on_bytes(self, data: bytes) -> List[Dict[str, Any]]:
         """
@@ -28,74 +64,68 @@ class ProtocolHandler:
           - 'angle': int en {0: roll, 1: pitch, 2: yaw}
           - 'value': float|int
 
-        Ejemplos de retorno:
-          # Un solo mensaje:
-          # return [{'station_index': 0, 'angle': 0, 'value': 12.5}]  # roll de grupo 0
-          # Varios mensajes:
-          # return [
-          #   {'station_index': 1, 'angle': 1, 'value': 20.0},  # pitch de grupo 1
-          #   {'station_index': 1, 'angle': 2, 'value': -7.2},  # yaw de grupo 1
-          # ]
-          # Lista vacía si no hay frames completos:
-          # return []
+        Lista vacía si no hay frames completos.
         """
-        # Descripcion del protocolo:
-        # Byte 0 - Start of Message: 0xAA
-        # Byte 1 - Station Index: 
-        # Bit 9+ Data - Prefix + Value: R/G/B + 0/1 for LED style commands or Y/P/T + 4 byte float for (yaw/pitch/roll) rotation data
-        # Last Bit sequence: 11111111 indicates end of message (0xFF)
-        self.buffer += data.decode('ascii', errors='ignore')
+        self.buffer += data
         logging.info(f"[ProtocolHandler] on_bytes() recibido {len(data)} bytes: {data}.")
-        if len(self.buffer) > 1024:
-            logging.warning("[ProtocolHandler] Buffer overflow. Limpiando buffer.")
-            self.buffer = str()
         result = []
-        while len(self.buffer) > 0:
-            if self.frame_start is False:
-                index = self.buffer.find('Begin:')
-                if index == -1:
-                    self.buffer = str()
-                    return result
-                self.buffer = self.buffer[index+6:]
-                if len(self.buffer) == 0:
-                    return result
-                self.frame_start = True
-            if self.current_station_index is None:
-                index = self.buffer.find('Group:')
-                if index == -1:
-                    return result
-                self.buffer = self.buffer[index+6:]
-                self.current_station_index = int(self.buffer[0:1])
-                self.buffer = self.buffer[1:]
-                if len(self.buffer) == 0:
-                    return result
-            if self.current_data_prefix is None:
-                self.current_data_prefix = self.buffer[0:1]
-                self.buffer = self.buffer[2:]
-            if self.current_data_value is None:
-                if self.current_data_prefix in ['R', 'G', 'B']:
-                    self.current_data_value = bool(int(self.buffer[0:1]))
-                    self.buffer = self.buffer[1:]
-                elif self.current_data_prefix in ['Y', 'P', 'T']:
-                    if len(self.buffer) < 5:
-                        return result
-                    self.current_data_value = float(self.buffer[:6])
-                    self.buffer = self.buffer[6:]
-            if self.frame_start is True and self.current_station_index is not None and self.current_data_prefix is not None and self.current_data_value is not None:
-                angle_map = {'Y': 2, 'P': 1, 'T': 0}
-                message = {
-                    'station_index': self.current_station_index,
-                    'angle': angle_map.get(self.current_data_prefix, -1),
-                    'value': self.current_data_value
-                  }
-                result.append(message)
-                self.frame_start = False
-                self.current_station_index = None
-                self.current_data_prefix = None
-                self.current_data_value = None
+
+        while True:
+            end = self.buffer.find(self.DELIMITER)
+            if end == -1:
+                break
+            frame = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            if frame:
+                result += self._parse_frame(frame)
+
+        if len(self.buffer) > self.MAX_BUFFER_SIZE:
+            logging.warning("[ProtocolHandler] Buffer overflow. Limpiando buffer.")
+            self.buffer.clear()
 
         return result
-        
+
+    def _parse_frame(self, frame: bytes) -> List[Dict[str, Any]]:
+        payload = self.cobs_decode(frame)
+        if payload is None or len(payload) < 4:
+            logging.warning(f"[ProtocolHandler] Frame inválido descartado: {frame}")
+            return []
+
+        crc = payload[-2] | (payload[-1] << 8)
+        body = payload[:-2]
+        if self.crc16(body) != crc:
+            self.crc_errors += 1
+            logging.warning(f"[ProtocolHandler] CRC inválido, frame descartado: {frame}")
+            return []
+
+        header, sequence = body[0], body[1]
+        station_index = header & 0x0F
+        use_float = bool(header & self.FORMAT_FLOAT)
+        value_format = '<f' if use_float else '<h'
+        value_size = struct.calcsize(value_format)
+
+        previous = self.last_sequence.get(station_index)
+        if previous is not None and sequence != (previous + 1) & 0xFF:
+            self.lost_frames += (sequence - previous - 1) & 0xFF
+        self.last_sequence[station_index] = sequence
+
+        messages = []
+        offset = 2
+        for angle in range(3):
+            if not header & (1 << (5 + angle)):
+                continue
+            if offset + value_size > len(body):
+                logging.warning(f"[ProtocolHandler] Frame incompleto descartado: {frame}")
+                return []
+            value = struct.unpack_from(value_format, body, offset)[0]
+            offset += value_size
+            messages.append({
+                'station_index': station_index,
+                'angle': angle,
+                'value': value if use_float else value / 100.0
+            })
+
+        return messages
 
     def build_led_command(self, station_index: int, r: bool, g: bool, b: bool) -> bytes:
         """
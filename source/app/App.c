@@ -15,6 +15,13 @@
 #include "hardware.h"
 #include "drivers/Timer.h"
 #include "drivers/UART.h"
+#include "Telemetry.h"
+#ifdef UART_BENCHMARK
+#include "UARTBenchmark.h"
+#endif
+#ifdef TIMER_BENCHMARK
+#include "TimerBenchmark.h"
+#endif
 
 /*******************************************************************************
  *                                MACROS
@@ -22,10 +29,25 @@
 
 #define MAX_STRING_LENGHT 16
 
+#define STATION_INDEX 3
+
+// Build with UART_BENCHMARK defined to measure the driver on a free UART at startup
+#define BENCHMARK_UART			1
+#define BENCHMARK_BAUD_RATE		115200
+#define BENCHMARK_DURATION_MS	2000
+
+// Build with TIMER_BENCHMARK defined to measure the tick interrupt with 1, 16 and 256 idle services and a busy
+// set of 16 services due every 10 ms. Add TIMER_TICKLESS to compare the interrupt rate against the SysTick
+#define TIMER_BENCHMARK_RUNS		4
+#define TIMER_BENCHMARK_DURATION_MS	1000
+
 /*******************************************************************************
  *                                VARIABLES
  ******************************************************************************/
 
+// PC link, holds the backlog of every station's telemetry
+UART_DEFINE_INSTANCE(uart0Buffers, 512, 2048);
+
 /*******************************************************************************
  *                           FUNCIONES GLOBALES
  ******************************************************************************/
@@ -34,6 +56,35 @@ static UART_Handle uart0;
 static UART_Handle uart3;
 static UART_Handle uart4;
 
+#ifdef UART_BENCHMARK
+// Inspect from the debugger once the first App_Run returns
+UARTBenchmark_Result benchmarkResult;
+#endif
+
+#ifdef TIMER_BENCHMARK
+static const uint16_t timerBenchmarkServices[TIMER_BENCHMARK_RUNS] = { 1, 16, 256, 16 };
+// Idle runs use a period longer than the run, so no service expires
+static const uint32_t timerBenchmarkPeriods[TIMER_BENCHMARK_RUNS] = { 10000, 10000, 10000, 10 };
+// Inspect from the debugger once the first App_Run returns
+TimerBenchmark_Result timerBenchmarkResults[TIMER_BENCHMARK_RUNS];
+#endif
+
+#if defined(UART_BENCHMARK) || defined(TIMER_BENCHMARK)
+static void RunBenchmarks(void)
+{
+#ifdef UART_BENCHMARK
+	UARTBenchmark_Run(BENCHMARK_UART, BENCHMARK_BAUD_RATE, BENCHMARK_DURATION_MS, &benchmarkResult);
+#endif
+
+#ifdef TIMER_BENCHMARK
+	for (uint8_t i = 0; i < TIMER_BENCHMARK_RUNS; i++)
+	{
+		TimerBenchmark_Run(timerBenchmarkServices[i], timerBenchmarkPeriods[i], TIMER_BENCHMARK_DURATION_MS, &timerBenchmarkResults[i]);
+	}
+#endif
+}
+#endif
+
 /* Función de inicialización */
 void App_Init (void)
 {
@@ -51,6 +102,10 @@ void App_Init (void)
 		uart_config.rx = PORTNUM2PIN(PB, 16);
 		uart_config.uartNum = 0;
 		uart_config.mode = UART_TRANSCEIVER;
+		UART_USE_INSTANCE(uart_config, uart0Buffers);
+		uart_config.rxWatermark = 6;
+		uart_config.txWatermark = 2;
+		uart_config.rxIdleTimeout = true;
 
 		uart0 = UART_Init(&uart_config);
 	}
@@ -80,35 +135,47 @@ void App_Init (void)
 	}
 }
 
-uint8_t buffer [128];
-
 /* Función que se llama constantemente en un ciclo infinito */
 void App_Run (void)
 {
 	static ticks prev = 0;
 
+#if defined(UART_BENCHMARK) || defined(TIMER_BENCHMARK)
+	// Not from App_Init, it runs with interrupts masked and the benchmarks wait on the tick
+	static bool benchmarked = false;
+	if (!benchmarked)
+	{
+		benchmarked = true;
+		RunBenchmarks();
+	}
+#endif
+
+	// Work the interrupts handed over, e.g. the button debouncing
+	TimerRunDeferred();
+
 	if (Now() - prev > MS_TO_TICKS(100))
 	{
 		prev = Now();
-		uint8_t address = 1;
-		char angle = 'Y';
-		float value = prev % 90;
-
-		buffer[0] = 0xAA;
-		memcpy(buffer, &address, 1);
-		memcpy(buffer + 2, &angle, 1);
-		memcpy(buffer + 3, &value, sizeof(float));
 
-		UART_WriteString(uart0, "Begin:Group:3Y:32.123");
-		//UART_WriteData(uart0, buffer, 7);
+		Telemetry_Sample sample = {};
+		sample.station = STATION_INDEX;
+		// The whole sample in one 12 byte frame, the ASCII link took a 21 byte line per angle
+		sample.angleMask = TELEMETRY_ANGLE_BIT(TELEMETRY_ROLL) | TELEMETRY_ANGLE_BIT(TELEMETRY_PITCH) | TELEMETRY_ANGLE_BIT(TELEMETRY_YAW);
+		sample.values[TELEMETRY_ROLL] = (float)(prev % 180) - 90.0f;
+		sample.values[TELEMETRY_PITCH] = (float)(prev % 90) - 45.0f;
+		sample.values[TELEMETRY_YAW] = prev % 90;
+
+		uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+		uint16_t size = Telemetry_Encode(&sample, frame);
+		UART_WriteData(uart0, frame, size);
 	}
 
-	if (UART_PollNewData(uart0) > 0)
+	// UART_GetData would need a buffer as big as the whole receive ring, read in place instead
+	UART_Span first, second;
+	uint16_t size = UART_Peek(uart0, &first, &second);
+	if (size > 0)
 	{
-		char retval;
-		uint16_t size;
-		bool err;
-		UART_GetData(uart0, &retval, &size, &err);
+		UART_Consume(uart0, size);
 		Sleep(1);
 	}
 
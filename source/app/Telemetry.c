@@ -0,0 +1,124 @@
+/***************************************************************************//**
+  @file     Telemetry.c
+  @brief    Binary telemetry frames for the PC link
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "Telemetry.h"
+#include <string.h>
+#include <math.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define CRC16_POLYNOMIAL	0x1021
+#define CRC16_INIT			0xFFFF
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+static uint8_t sequence = 0;
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static int16_t ToHundredths(float value)
+{
+	float scaled = roundf(value * 100.0f);
+	if (scaled > INT16_MAX)
+		return INT16_MAX;
+	if (scaled < INT16_MIN)
+		return INT16_MIN;
+	return (int16_t)scaled;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+uint16_t Telemetry_CRC16(const uint8_t* pData, uint16_t size)
+{
+	uint16_t crc = CRC16_INIT;
+	for (uint16_t i = 0; i < size; i++)
+	{
+		crc ^= (uint16_t)pData[i] << 8;
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ CRC16_POLYNOMIAL : crc << 1;
+		}
+	}
+	return crc;
+}
+
+uint16_t Telemetry_COBSEncode(const uint8_t* pIn, uint16_t size, uint8_t* pOut)
+{
+	// Each block starts with the distance to the next zero, the zeros themselves are dropped
+	uint16_t codeIndex = 0;
+	uint16_t outIndex = 1;
+	uint8_t code = 1;
+
+	for (uint16_t i = 0; i < size; i++)
+	{
+		if (pIn[i] != 0)
+		{
+			pOut[outIndex++] = pIn[i];
+			code++;
+		}
+
+		if (pIn[i] == 0 || code == 0xFF)
+		{
+			pOut[codeIndex] = code;
+			codeIndex = outIndex++;
+			code = 1;
+		}
+	}
+
+	pOut[codeIndex] = code;
+	return outIndex;
+}
+
+uint16_t Telemetry_Encode(const Telemetry_Sample* pSample, uint8_t* pFrame)
+{
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD_SIZE];
+	uint16_t size = 0;
+
+	uint8_t angleMask = pSample->angleMask & (TELEMETRY_ANGLE_BIT(TELEMETRY_ROLL) | TELEMETRY_ANGLE_BIT(TELEMETRY_PITCH) | TELEMETRY_ANGLE_BIT(TELEMETRY_YAW));
+	payload[size++] = (pSample->station & (TELEMETRY_MAX_STATIONS - 1)) | (pSample->useFloat ? TELEMETRY_FORMAT_FLOAT : 0) | angleMask;
+	payload[size++] = sequence++;
+
+	for (uint8_t angle = TELEMETRY_ROLL; angle <= TELEMETRY_YAW; angle++)
+	{
+		if (!(angleMask & TELEMETRY_ANGLE_BIT(angle)))
+			continue;
+
+		if (pSample->useFloat)
+		{
+			// The K64F is little endian like the wire format
+			memcpy(&payload[size], &pSample->values[angle], sizeof(float));
+			size += sizeof(float);
+		}
+		else
+		{
+			uint16_t value = (uint16_t)ToHundredths(pSample->values[angle]);
+			payload[size++] = value & 0xFF;
+			payload[size++] = value >> 8;
+		}
+	}
+
+	uint16_t crc = Telemetry_CRC16(payload, size);
+	payload[size++] = crc & 0xFF;
+	payload[size++] = crc >> 8;
+
+	uint16_t frameSize = Telemetry_COBSEncode(payload, size, pFrame);
+	pFrame[frameSize++] = 0x00;
+	return frameSize;
+}
+
+/*******************************************************************************
+ ******************************************************************************/
@@ -0,0 +1,69 @@
+/***************************************************************************//**
+  @file     Telemetry.h
+  @brief    Binary telemetry frames for the PC link. COBS encoded, 0x00 delimited, CRC-16 protected
+  @author   Group 2
+ ******************************************************************************/
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+/*******************************************************************************
+*                                ENCABEZADOS
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+*                                  MACROS
+******************************************************************************/
+
+// Frame before encoding:
+//   [0]    header: station (bits 0-3), TELEMETRY_FORMAT_FLOAT (bit 4), roll/pitch/yaw present (bits 5-7)
+//   [1]    sequence number
+//   [2..]  one value per present angle, in roll, pitch, yaw order. Little endian int16 in hundredths
+//          of a degree, or float32 with TELEMETRY_FORMAT_FLOAT
+//   [n..]  CRC-16/CCITT-FALSE of the bytes above, little endian
+// The whole frame is COBS encoded and terminated by a single 0x00
+
+#define TELEMETRY_MAX_STATIONS		16
+#define TELEMETRY_FORMAT_FLOAT		(1u << 4)
+#define TELEMETRY_ANGLE_BIT(angle)	(1u << (5 + (angle)))
+
+#define TELEMETRY_MAX_PAYLOAD_SIZE	(2 + 3 * sizeof(float) + 2)
+// COBS adds one byte every 254 plus the delimiter
+#define TELEMETRY_MAX_FRAME_SIZE	(TELEMETRY_MAX_PAYLOAD_SIZE + 2)
+
+/*******************************************************************************
+*                                ENUMERACIONES
+******************************************************************************/
+typedef enum
+{
+	TELEMETRY_ROLL,
+	TELEMETRY_PITCH,
+	TELEMETRY_YAW
+} Telemetry_Angle;
+
+/*******************************************************************************
+*                                  OBJETOS
+******************************************************************************/
+typedef struct
+{
+	uint8_t station;
+	uint8_t angleMask;		// TELEMETRY_ANGLE_BIT of every angle to send
+	bool useFloat;			// Full float values instead of hundredths of a degree
+	float values[3];		// Indexed by Telemetry_Angle, degrees
+} Telemetry_Sample;
+
+/*******************************************************************************
+*                                 FUNCIONES
+******************************************************************************/
+
+// Builds the encoded frame, delimiter included, and returns its size. pFrame needs TELEMETRY_MAX_FRAME_SIZE bytes
+uint16_t Telemetry_Encode(const Telemetry_Sample* pSample, uint8_t* pFrame);
+
+uint16_t Telemetry_CRC16(const uint8_t* pData, uint16_t size);
+
+// Encodes size bytes into pOut (at most size + size / 254 + 1 bytes), without the delimiter. Returns the encoded size
+uint16_t Telemetry_COBSEncode(const uint8_t* pIn, uint16_t size, uint8_t* pOut);
+
+#endif /* _TELEMETRY_H_ */
@@ -0,0 +1,65 @@
+/***************************************************************************//**
+  @file     TimerBenchmark.c
+  @brief    Cost of the timer tick interrupt as the number of services grows
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "TimerBenchmark.h"
+#include <stdlib.h>
+#include <string.h>
+#include "drivers/Timer.h"
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static void EmptyService(void* user_data)
+{
+	(void)user_data;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+bool TimerBenchmark_Run(uint16_t services, uint32_t periodMs, uint32_t durationMs, TimerBenchmark_Result* pResult)
+{
+	service_id* pIds = (service_id*)malloc(sizeof(service_id) * services);
+	if (pIds == 0)
+		return false;
+
+	for (uint16_t i = 0; i < services; i++)
+	{
+		pIds[i] = TimerRegisterPeriodicInterruption(&EmptyService, MS_TO_TICKS(periodMs), 0);
+		// Restart the count so they do not all expire on the first tick
+		TimerSetEnable(pIds[i], true);
+	}
+
+	TimerResetStats();
+	Sleep(MS_TO_TICKS(durationMs));
+
+	TimerStats stats;
+	TimerGetStats(&stats);
+
+	for (uint16_t i = 0; i < services; i++)
+	{
+		TimerUnregisterPeriodicInterruption(pIds[i]);
+	}
+	free(pIds);
+
+	memset(pResult, 0, sizeof(TimerBenchmark_Result));
+	pResult->services = services;
+	pResult->interrupts = stats.interrupts;
+	pResult->interruptsPerSecond = durationMs ? (uint32_t)((uint64_t)stats.interrupts * 1000 / durationMs) : 0;
+	pResult->callbacks = stats.callbacks;
+	pResult->avgCycles = stats.interrupts ? stats.isrCycles / stats.interrupts : 0;
+	pResult->maxCycles = stats.isrMaxCycles;
+
+	return true;
+}
+
+/*******************************************************************************
+ ******************************************************************************/
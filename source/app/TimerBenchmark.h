@@ -0,0 +1,38 @@
+/***************************************************************************//**
+  @file     TimerBenchmark.h
+  @brief    Cost of the timer tick interrupt as the number of services grows
+  @author   Group 2
+ ******************************************************************************/
+
+#ifndef _TIMER_BENCHMARK_H_
+#define _TIMER_BENCHMARK_H_
+
+/*******************************************************************************
+*                                ENCABEZADOS
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+*                                  OBJETOS
+******************************************************************************/
+typedef struct
+{
+	uint16_t services;			// Services registered on top of the existing ones
+	uint32_t interrupts;		// Timer interrupts during the run
+	uint32_t interruptsPerSecond;	// 1000 with the SysTick, as many as there are distinct deadlines when tickless
+	uint32_t callbacks;			// Services that expired during the run
+	uint32_t avgCycles;			// Core cycles per tick interrupt
+	uint32_t maxCycles;
+} TimerBenchmark_Result;
+
+/*******************************************************************************
+*                                 FUNCIONES
+******************************************************************************/
+
+// Registers the given number of services, each due once every periodMs, and measures the tick interrupt
+// for durationMs. A period longer than the run measures the cost of the idle services alone.
+// Blocks for the whole run and unregisters the services before returning. Needs TimerInit
+bool TimerBenchmark_Run(uint16_t services, uint32_t periodMs, uint32_t durationMs, TimerBenchmark_Result* pResult);
+
+#endif /* _TIMER_BENCHMARK_H_ */
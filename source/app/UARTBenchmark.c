@@ -0,0 +1,177 @@
+/***************************************************************************//**
+  @file     UARTBenchmark.c
+  @brief    UART driver throughput and latency benchmark over the internal loopback
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "UARTBenchmark.h"
+#include <string.h>
+#include "hardware.h"
+#include "drivers/Timer.h"
+#include "drivers/UART.h"
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+// Packet: sync, sequence, CYCCNT at the write (little endian) and a pattern derived from the sequence
+#define PACKET_SYNC			0xA5
+#define PACKET_SIZE			16
+#define PACKET_HEADER_SIZE	6
+
+// Time for the bytes in flight to come back once the run ends, on top of what the full transmit ring takes
+#define DRAIN_TIME_MS		50
+#define TRANSMIT_RING_SIZE	1024
+#define BITS_PER_CHARACTER	10
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+UART_DEFINE_INSTANCE(benchmarkBuffers, 1024, TRANSMIT_RING_SIZE);
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static void BuildPacket(uint8_t* pPacket, uint8_t sequence)
+{
+	uint32_t now = DWT->CYCCNT;
+	pPacket[0] = PACKET_SYNC;
+	pPacket[1] = sequence;
+	memcpy(&pPacket[2], &now, sizeof(now));
+	for (uint8_t i = PACKET_HEADER_SIZE; i < PACKET_SIZE; i++)
+	{
+		pPacket[i] = sequence + i;
+	}
+}
+
+static bool CheckPacket(const uint8_t* pPacket, uint8_t expectedSequence)
+{
+	if (pPacket[0] != PACKET_SYNC || pPacket[1] != expectedSequence)
+		return false;
+
+	for (uint8_t i = PACKET_HEADER_SIZE; i < PACKET_SIZE; i++)
+	{
+		if (pPacket[i] != (uint8_t)(pPacket[1] + i))
+			return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+bool UARTBenchmark_Run(uint8_t uartNum, uint32_t baudRate, uint32_t durationMs, UARTBenchmark_Result* pResult)
+{
+	UART_Config config = {};
+	config.skipPinSetup = true;
+	config.loopback = true;
+	config.uartNum = uartNum;
+	config.mode = UART_TRANSCEIVER;
+	config.baudRate = baudRate;
+	config.rxWatermark = 4;
+	config.txWatermark = 2;
+	config.rxIdleTimeout = true;
+	UART_USE_INSTANCE(config, benchmarkBuffers);
+
+	UART_Handle uart = UART_Init(&config);
+	if (uart < 0)
+		return false;
+
+	memset(pResult, 0, sizeof(UARTBenchmark_Result));
+	pResult->minLatency = UINT32_MAX;
+	uint64_t totalLatency = 0;
+	uint32_t goodPackets = 0;
+
+	uint8_t txSequence = 0;
+	uint8_t rxSequence = 0;
+	uint8_t packet[PACKET_SIZE];
+	uint8_t received[PACKET_SIZE];
+	uint8_t receivedSize = 0;
+
+	ticks start = Now();
+	ticks end = start + MS_TO_TICKS(durationMs);
+	uint32_t ringMs = (uint32_t)((uint64_t)TRANSMIT_RING_SIZE * BITS_PER_CHARACTER * 1000 / baudRate);
+	ticks drainEnd = end + MS_TO_TICKS(ringMs + DRAIN_TIME_MS);
+	ticks lastReceived = start;
+
+	while (Now() < drainEnd)
+	{
+		if (Now() >= end && pResult->bytesReceived == pResult->bytesSent)
+			break;
+
+		// Keep the transmit ring full during the run
+		if (Now() < end)
+		{
+			BuildPacket(packet, txSequence);
+			if (UART_WriteData(uart, packet, PACKET_SIZE))
+			{
+				txSequence++;
+				pResult->bytesSent += PACKET_SIZE;
+			}
+		}
+
+		UART_Span first, second;
+		uint16_t size = UART_Peek(uart, &first, &second);
+		if (size != 0)
+			lastReceived = Now();
+		for (uint16_t i = 0; i < size; i++)
+		{
+			uint8_t data = i < first.size ? first.pData[i] : second.pData[i - first.size];
+
+			// Resynchronize on the sync byte after a loss
+			if (receivedSize == 0 && data != PACKET_SYNC)
+			{
+				pResult->bytesReceived++;
+				continue;
+			}
+			received[receivedSize++] = data;
+			pResult->bytesReceived++;
+
+			if (receivedSize < PACKET_SIZE)
+				continue;
+			receivedSize = 0;
+
+			if (!CheckPacket(received, rxSequence))
+			{
+				pResult->badPackets++;
+				rxSequence = received[1] + 1;
+				continue;
+			}
+			rxSequence++;
+
+			uint32_t sentAt;
+			memcpy(&sentAt, &received[2], sizeof(sentAt));
+			uint32_t latency = DWT->CYCCNT - sentAt;
+			totalLatency += latency;
+			goodPackets++;
+			if (latency < pResult->minLatency)
+				pResult->minLatency = latency;
+			if (latency > pResult->maxLatency)
+				pResult->maxLatency = latency;
+		}
+		UART_Consume(uart, size);
+	}
+
+	UART_Stats stats;
+	UART_GetStats(uart, &stats);
+	UART_Delete(uart);
+
+	pResult->interrupts = stats.rxTxInterrupts + stats.errorInterrupts + stats.dmaInterrupts;
+	pResult->lostBytes = pResult->bytesSent > pResult->bytesReceived ? pResult->bytesSent - pResult->bytesReceived : 0;
+	uint64_t receiveMs = (lastReceived - start) * 1000 / TICKS_PER_SECOND;
+	pResult->bytesPerSecond = receiveMs ? (uint32_t)((uint64_t)pResult->bytesReceived * 1000 / receiveMs) : 0;
+	pResult->avgLatency = goodPackets ? (uint32_t)(totalLatency / goodPackets) : 0;
+	if (goodPackets == 0)
+		pResult->minLatency = 0;
+
+	return true;
+}
+
+/*******************************************************************************
+ ******************************************************************************/
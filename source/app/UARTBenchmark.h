@@ -0,0 +1,40 @@
+/***************************************************************************//**
+  @file     UARTBenchmark.h
+  @brief    UART driver throughput and latency benchmark over the internal loopback
+  @author   Group 2
+ ******************************************************************************/
+
+#ifndef _UART_BENCHMARK_H_
+#define _UART_BENCHMARK_H_
+
+/*******************************************************************************
+*                                ENCABEZADOS
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+*                                  OBJETOS
+******************************************************************************/
+typedef struct
+{
+	uint32_t bytesSent;
+	uint32_t bytesReceived;
+	uint32_t bytesPerSecond;	// Received bytes over the time until the last one came back
+	uint32_t lostBytes;			// Sent but never received once the line drained
+	uint32_t badPackets;		// Packets received with a wrong sequence or pattern
+	uint32_t interrupts;		// Driver interrupts during the run
+	uint32_t minLatency;		// Core cycles from the write of a packet until it was read back
+	uint32_t avgLatency;
+	uint32_t maxLatency;
+} UARTBenchmark_Result;
+
+/*******************************************************************************
+*                                 FUNCIONES
+******************************************************************************/
+
+// Streams patterned packets through a free UART with LOOPS set for durationMs. Blocks for the whole run.
+// Returns false if the UART could not be initialized. Needs TimerInit
+bool UARTBenchmark_Run(uint8_t uartNum, uint32_t baudRate, uint32_t durationMs, UARTBenchmark_Result* pResult);
+
+#endif /* _UART_BENCHMARK_H_ */
@@ -46,7 +46,8 @@ void ButtonISR(void* user_data)
 	TimerSetEnable(pButton->debouncingIsrId, true);
 }
 
-void DebouncingISR(void* user_data)
+// Runs from the main loop through TimerRunDeferred, the tick interrupt only posts it
+void DebouncingTask(void* user_data)
 {
 	if (semaphore)
 		return;
@@ -78,8 +79,8 @@ void DebouncingISR(void* user_data)
 	}
 
 
+	// The one-shot is already disarmed, the next edge arms it again
 	gpioSetupISR(pButton->pin, pButton->isrType, &ButtonISR, pButton);
-	TimerSetEnable(pButton->debouncingIsrId,false);
 }
 
 uint16_t NewButton(pin_t pin, bool activeHigh)
@@ -109,8 +110,9 @@ uint16_t NewButton(pin_t pin, bool activeHigh)
 	pButton->debouncingTickInterval = 0;
 	pButton->debouncingIsrId = 0;
 	pButton->state = BUTTON_IDLE;
-	pButton->debouncingIsrId = TimerRegisterPeriodicInterruption(&DebouncingISR, MS_TO_TICKS(4), pButton);
+	pButton->debouncingIsrId = TimerRegisterOneShot(&DebouncingTask, MS_TO_TICKS(4), pButton);
 	pButton->holdTickInterval = MS_TO_TICKS(1000);
+	TimerSetDeferred(pButton->debouncingIsrId, true);
 	TimerSetEnable(pButton->debouncingIsrId, false);
 
 	gpioMode(pButton->pin, pButton->inputMode);
@@ -0,0 +1,165 @@
+/***************************************************************************//**
+  @file     DMA.c
+  @brief    eDMA channel driver
+  @author   Group 2
+ ******************************************************************************/
+
+#include "DMA.h"
+#include "hardware.h"
+
+typedef struct {
+	callback* pCallback;
+	void* user_data;
+	callback* pErrorCallback;
+	void* errorUserData;
+	bool used;
+} DMAChannelState;
+
+static DMAChannelState channels[DMA_CHANNEL_COUNT];
+static bool initialized = false;
+
+static void DMA_InitModule()
+{
+	SIM->SCGC6 |= SIM_SCGC6_DMAMUX(1);
+	SIM->SCGC7 |= SIM_SCGC7_DMA(1);
+
+	// Fixed priority arbitration. An error only stops the channel it happened on
+	DMA0->CR = 0;
+	NVIC_EnableIRQ(DMA_Error_IRQn);
+	initialized = true;
+}
+
+DMA_Channel DMA_RequestChannel(uint8_t requestSource, callback* pCallback, void* user_data)
+{
+	if (!initialized)
+	{
+		DMA_InitModule();
+	}
+
+	for (DMA_Channel ch = 0; ch < DMA_CHANNEL_COUNT; ch++)
+	{
+		if (channels[ch].used)
+			continue;
+
+		channels[ch].used = true;
+		channels[ch].pCallback = pCallback;
+		channels[ch].user_data = user_data;
+		channels[ch].pErrorCallback = 0;
+
+		DMA0->CERQ = DMA_CERQ_CERQ(ch);
+		DMA0->CERR = DMA_CERR_CERR(ch);
+		DMA0->SEEI = DMA_SEEI_SEEI(ch);
+		DMAMUX->CHCFG[ch] = 0;
+		DMAMUX->CHCFG[ch] = DMAMUX_CHCFG_SOURCE(requestSource) | DMAMUX_CHCFG_ENBL(1);
+		NVIC_EnableIRQ(DMA0_IRQn + ch);
+		return ch;
+	}
+
+	return -1;
+}
+
+void DMA_ReleaseChannel(DMA_Channel channel)
+{
+	DMA0->CERQ = DMA_CERQ_CERQ(channel);
+	DMA0->CEEI = DMA_CEEI_CEEI(channel);
+	DMAMUX->CHCFG[channel] = 0;
+	NVIC_DisableIRQ(DMA0_IRQn + channel);
+	channels[channel].used = false;
+	channels[channel].pCallback = 0;
+	channels[channel].pErrorCallback = 0;
+}
+
+void DMA_SetErrorCallback(DMA_Channel channel, callback* pCallback, void* user_data)
+{
+	channels[channel].pErrorCallback = pCallback;
+	channels[channel].errorUserData = user_data;
+}
+
+void DMA_SetupTransfer(DMA_Channel channel, const DMA_Transfer* pTransfer)
+{
+	DMA0->CDNE = DMA_CDNE_CDNE(channel);
+
+	DMA0->TCD[channel].SADDR = (uint32_t)(uintptr_t)pTransfer->pSource;
+	DMA0->TCD[channel].SOFF = (uint16_t)pTransfer->sourceOffset;
+	DMA0->TCD[channel].DADDR = (uint32_t)(uintptr_t)pTransfer->pDestination;
+	DMA0->TCD[channel].DOFF = (uint16_t)pTransfer->destinationOffset;
+
+	// 8 bit source and destination, one byte per request
+	DMA0->TCD[channel].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+	DMA0->TCD[channel].NBYTES_MLNO = DMA_NBYTES_MLNO_NBYTES(1);
+
+	DMA0->TCD[channel].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(pTransfer->count);
+	DMA0->TCD[channel].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(pTransfer->count);
+	DMA0->TCD[channel].SLAST = (uint32_t)pTransfer->sourceLastAdjust;
+	DMA0->TCD[channel].DLAST_SGA = (uint32_t)pTransfer->destinationLastAdjust;
+
+	DMA0->TCD[channel].CSR = DMA_CSR_DREQ(pTransfer->disableRequestOnDone) | DMA_CSR_INTMAJOR(pTransfer->interruptOnDone) |
+			DMA_CSR_INTHALF(pTransfer->interruptOnHalf);
+}
+
+void DMA_EnableRequest(DMA_Channel channel)
+{
+	DMA0->SERQ = DMA_SERQ_SERQ(channel);
+}
+
+void DMA_DisableRequest(DMA_Channel channel)
+{
+	DMA0->CERQ = DMA_CERQ_CERQ(channel);
+}
+
+uint16_t DMA_GetRemainingCount(DMA_Channel channel)
+{
+	return DMA0->TCD[channel].CITER_ELINKNO & DMA_CITER_ELINKNO_CITER_MASK;
+}
+
+static void DMAX_IRQImpl(uint8_t channel)
+{
+	DMA0->CINT = DMA_CINT_CINT(channel);
+
+	DMAChannelState* pChannel = &channels[channel];
+	if (pChannel->pCallback)
+	{
+		pChannel->pCallback(pChannel->user_data);
+	}
+}
+
+__ISR__ DMA_Error_IRQHandler(void)
+{
+	// The owner of each failed channel restarts its own transfer
+	uint32_t errors = DMA0->ERR;
+	for (DMA_Channel ch = 0; ch < DMA_CHANNEL_COUNT; ch++)
+	{
+		if ((errors & (1u << ch)) == 0)
+			continue;
+
+		DMA0->CERR = DMA_CERR_CERR(ch);
+		DMAChannelState* pChannel = &channels[ch];
+		if (pChannel->pErrorCallback)
+		{
+			pChannel->pErrorCallback(pChannel->errorUserData);
+		}
+	}
+}
+
+#define DMAX_IRQ_IMPL(x)				\
+__ISR__ DMA##x##_IRQHandler(void)		\
+{										\
+	DMAX_IRQImpl(x);					\
+}
+
+DMAX_IRQ_IMPL(0)
+DMAX_IRQ_IMPL(1)
+DMAX_IRQ_IMPL(2)
+DMAX_IRQ_IMPL(3)
+DMAX_IRQ_IMPL(4)
+DMAX_IRQ_IMPL(5)
+DMAX_IRQ_IMPL(6)
+DMAX_IRQ_IMPL(7)
+DMAX_IRQ_IMPL(8)
+DMAX_IRQ_IMPL(9)
+DMAX_IRQ_IMPL(10)
+DMAX_IRQ_IMPL(11)
+DMAX_IRQ_IMPL(12)
+DMAX_IRQ_IMPL(13)
+DMAX_IRQ_IMPL(14)
+DMAX_IRQ_IMPL(15)
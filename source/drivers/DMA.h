@@ -0,0 +1,48 @@
+/***************************************************************************//**
+  @file     DMA.h
+  @brief    eDMA channel driver
+  @author   Group 2
+ ******************************************************************************/
+
+#ifndef DRIVERS_DMA_H_
+#define DRIVERS_DMA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Callback.h"
+
+#define DMA_CHANNEL_COUNT 16
+#define DMA_MAX_COUNT 32767u		// CITER and BITER are 15 bit wide without channel linking
+
+typedef int8_t DMA_Channel;
+
+// Byte wide transfer description. One major loop iteration moves one byte.
+typedef struct {
+	const volatile void* pSource;
+	volatile void* pDestination;
+	int16_t sourceOffset;			// Added to the source address after each byte
+	int16_t destinationOffset;		// Added to the destination address after each byte
+	uint16_t count;					// Number of bytes of the major loop (1 to DMA_MAX_COUNT)
+	int32_t sourceLastAdjust;		// Added to the source address when the major loop completes
+	int32_t destinationLastAdjust;	// Added to the destination address when the major loop completes
+	bool disableRequestOnDone;		// Stop serving hardware requests once the major loop completes
+	bool interruptOnDone;			// Call the channel callback once the major loop completes
+	bool interruptOnHalf;			// Also call it once half the major loop is done
+} DMA_Transfer;
+
+// Allocates a free channel routed to the given DMAMUX request source. Returns -1 if none is left.
+DMA_Channel DMA_RequestChannel(uint8_t requestSource, callback* pCallback, void* user_data);
+void DMA_ReleaseChannel(DMA_Channel channel);
+
+// Called from the error interrupt when a transfer on the channel fails. The other channels keep running, the
+// failed one stops serving requests until its owner sets up a new transfer or enables them again
+void DMA_SetErrorCallback(DMA_Channel channel, callback* pCallback, void* user_data);
+
+void DMA_SetupTransfer(DMA_Channel channel, const DMA_Transfer* pTransfer);
+void DMA_EnableRequest(DMA_Channel channel);
+void DMA_DisableRequest(DMA_Channel channel);
+
+// Remaining iterations of the major loop in progress
+uint16_t DMA_GetRemainingCount(DMA_Channel channel);
+
+#endif /* DRIVERS_DMA_H_ */
@@ -0,0 +1,264 @@
+/***************************************************************************//**
+  @file     RingBuffer.c
+  @brief    Lock free byte ring buffer
+  @author   Group 2
+ ******************************************************************************/
+
+#include "RingBuffer.h"
+#include <string.h>
+
+// Data must be visible before the index that publishes it, and read before the index that releases it
+#ifdef __arm__
+#include "hardware.h"
+#define RING_BUFFER_BARRIER() __DMB()
+#else
+#define RING_BUFFER_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define WRITER_COUNT_ONE 0x10000u
+#define RESERVED_HEAD(reservation) ((uint16_t)((reservation) & 0xFFFF))
+#define WRITER_COUNT(reservation) ((reservation) >> 16)
+
+// Compare and swap. On the Cortex-M4 the exclusive monitor is cleared by every exception entry and return,
+// so a writer preempted between LDREX and STREX simply retries
+static inline bool RingBuffer_UpdateWord(volatile uint32_t* pWord, uint32_t expected, uint32_t desired)
+{
+#ifdef __arm__
+	if (__LDREXW(pWord) != expected)
+	{
+		__CLREX();
+		return false;
+	}
+	return __STREXW(desired, pWord) == 0;
+#else
+	return __atomic_compare_exchange_n(pWord, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline bool RingBuffer_UpdateHalfWord(volatile uint16_t* pHalfWord, uint16_t expected, uint16_t desired)
+{
+#ifdef __arm__
+	if (__LDREXH(pHalfWord) != expected)
+	{
+		__CLREX();
+		return false;
+	}
+	return __STREXH(desired, pHalfWord) == 0;
+#else
+	return __atomic_compare_exchange_n(pHalfWord, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+bool RingBuffer_Init(RingBuffer* pRing, uint8_t* pBuffer, uint16_t capacity)
+{
+	if (capacity == 0 || capacity > RING_BUFFER_MAX_CAPACITY || (capacity & (capacity - 1)) != 0)
+	{
+		return false;
+	}
+
+	pRing->pBuffer = pBuffer;
+	pRing->mask = capacity - 1;
+	pRing->head = 0;
+	pRing->tail = 0;
+	pRing->reservation = 0;
+	return true;
+}
+
+void RingBuffer_Reset(RingBuffer* pRing)
+{
+	pRing->head = 0;
+	pRing->tail = 0;
+	pRing->reservation = 0;
+}
+
+uint16_t RingBuffer_Capacity(const RingBuffer* pRing)
+{
+	return (uint16_t)(pRing->mask + 1);
+}
+
+uint16_t RingBuffer_Count(const RingBuffer* pRing)
+{
+	return (uint16_t)(pRing->head - pRing->tail);
+}
+
+uint16_t RingBuffer_Free(const RingBuffer* pRing)
+{
+	uint16_t count = RingBuffer_Count(pRing);
+	uint16_t capacity = RingBuffer_Capacity(pRing);
+	return count >= capacity ? 0 : capacity - count;
+}
+
+bool RingBuffer_Push(RingBuffer* pRing, uint8_t data)
+{
+	uint16_t head = pRing->head;
+	if ((uint16_t)(head - pRing->tail) > pRing->mask)
+	{
+		return false;
+	}
+
+	// The consumer must be done with the slot before it is overwritten
+	RING_BUFFER_BARRIER();
+	pRing->pBuffer[head & pRing->mask] = data;
+	RING_BUFFER_BARRIER();
+	pRing->head = head + 1;
+	return true;
+}
+
+uint16_t RingBuffer_Write(RingBuffer* pRing, const uint8_t* pData, uint16_t size)
+{
+	uint16_t head = pRing->head;
+	uint16_t freeBytes = RingBuffer_Free(pRing);
+	size = MIN(size, freeBytes);
+	RING_BUFFER_BARRIER();
+
+	// Copy in two parts if the data wraps around the end of the storage
+	uint16_t offset = head & pRing->mask;
+	uint16_t firstBatchSize = MIN(size, RingBuffer_Capacity(pRing) - offset);
+	memcpy(pRing->pBuffer + offset, pData, firstBatchSize);
+	memcpy(pRing->pBuffer, pData + firstBatchSize, size - firstBatchSize);
+
+	RING_BUFFER_BARRIER();
+	pRing->head = head + size;
+	return size;
+}
+
+void RingBuffer_Commit(RingBuffer* pRing, uint16_t size)
+{
+	RING_BUFFER_BARRIER();
+	pRing->head = pRing->head + size;
+}
+
+bool RingBuffer_Reserve(RingBuffer* pRing, uint16_t size, uint16_t* pPosition)
+{
+	uint32_t reservation;
+	uint16_t reservedHead;
+	do
+	{
+		reservation = pRing->reservation;
+		reservedHead = RESERVED_HEAD(reservation);
+		if ((uint32_t)(uint16_t)(reservedHead - pRing->tail) + size > RingBuffer_Capacity(pRing))
+		{
+			return false;
+		}
+	} while (!RingBuffer_UpdateWord(&pRing->reservation, reservation,
+			((reservation & 0xFFFF0000u) + WRITER_COUNT_ONE) | (uint16_t)(reservedHead + size)));
+
+	// The consumer must be done with the space before it is overwritten
+	RING_BUFFER_BARRIER();
+	*pPosition = reservedHead;
+	return true;
+}
+
+void RingBuffer_WriteAtPosition(RingBuffer* pRing, uint16_t position, const void* pData, uint16_t size)
+{
+	uint16_t index = position & pRing->mask;
+	uint16_t firstBatchSize = MIN(size, RingBuffer_Capacity(pRing) - index);
+	memcpy(pRing->pBuffer + index, pData, firstBatchSize);
+	memcpy(pRing->pBuffer, (const uint8_t*)pData + firstBatchSize, size - firstBatchSize);
+}
+
+void RingBuffer_CommitReserved(RingBuffer* pRing)
+{
+	// The data must be visible before it can be published
+	RING_BUFFER_BARRIER();
+
+	uint32_t reservation;
+	do
+	{
+		reservation = pRing->reservation;
+	} while (!RingBuffer_UpdateWord(&pRing->reservation, reservation, reservation - WRITER_COUNT_ONE));
+
+	// Someone else is still copying, the last one out publishes this data too
+	if (WRITER_COUNT(reservation - WRITER_COUNT_ONE) != 0)
+		return;
+
+	// Every byte up to the reserved head is in place. A committer that was preempted before this point may still
+	// publish an older head, so the head only ever moves forward
+	uint16_t reservedHead = RESERVED_HEAD(reservation);
+	uint16_t head;
+	do
+	{
+		head = pRing->head;
+		if ((int16_t)(reservedHead - head) <= 0)
+			return;
+	} while (!RingBuffer_UpdateHalfWord(&pRing->head, head, reservedHead));
+}
+
+bool RingBuffer_Pop(RingBuffer* pRing, uint8_t* pData)
+{
+	uint16_t tail = pRing->tail;
+	if (pRing->head == tail)
+	{
+		return false;
+	}
+
+	RING_BUFFER_BARRIER();
+	*pData = pRing->pBuffer[tail & pRing->mask];
+	RING_BUFFER_BARRIER();
+	pRing->tail = tail + 1;
+	return true;
+}
+
+uint16_t RingBuffer_Read(RingBuffer* pRing, uint8_t* pData, uint16_t size)
+{
+	uint16_t tail = pRing->tail;
+	uint16_t count = RingBuffer_Count(pRing);
+	size = MIN(size, count);
+	RING_BUFFER_BARRIER();
+
+	uint16_t offset = tail & pRing->mask;
+	uint16_t firstBatchSize = MIN(size, RingBuffer_Capacity(pRing) - offset);
+	memcpy(pData, pRing->pBuffer + offset, firstBatchSize);
+	memcpy(pData + firstBatchSize, pRing->pBuffer, size - firstBatchSize);
+
+	RING_BUFFER_BARRIER();
+	pRing->tail = tail + size;
+	return size;
+}
+
+uint16_t RingBuffer_PeekContiguous(const RingBuffer* pRing, const uint8_t** ppData)
+{
+	uint16_t tail = pRing->tail;
+	uint16_t count = RingBuffer_Count(pRing);
+	RING_BUFFER_BARRIER();
+
+	uint16_t offset = tail & pRing->mask;
+	*ppData = pRing->pBuffer + offset;
+	return MIN(count, RingBuffer_Capacity(pRing) - offset);
+}
+
+uint16_t RingBuffer_Peek(const RingBuffer* pRing, RingBuffer_Span* pFirst, RingBuffer_Span* pSecond)
+{
+	uint16_t tail = pRing->tail;
+	uint16_t count = RingBuffer_Count(pRing);
+	RING_BUFFER_BARRIER();
+
+	uint16_t offset = tail & pRing->mask;
+	pFirst->pData = pRing->pBuffer + offset;
+	pFirst->size = MIN(count, RingBuffer_Capacity(pRing) - offset);
+	pSecond->pData = pRing->pBuffer;
+	pSecond->size = count - pFirst->size;
+	return count;
+}
+
+void RingBuffer_Consume(RingBuffer* pRing, uint16_t size)
+{
+	uint16_t count = RingBuffer_Count(pRing);
+	size = MIN(size, count);
+	RING_BUFFER_BARRIER();
+	pRing->tail = pRing->tail + size;
+}
+
+bool RingBuffer_DiscardOverrun(RingBuffer* pRing)
+{
+	uint16_t head = pRing->head;
+	if ((uint16_t)(head - pRing->tail) <= RingBuffer_Capacity(pRing))
+	{
+		return false;
+	}
+
+	pRing->tail = head - RingBuffer_Capacity(pRing);
+	return true;
+}
@@ -0,0 +1,69 @@
+/***************************************************************************//**
+  @file     RingBuffer.h
+  @brief    Lock free byte ring buffer
+  @author   Group 2
+ ******************************************************************************/
+
+/*
+ * Lock free single producer / single consumer byte ring. The capacity is a power of two and head/tail are
+ * free running 16 bit counters, so the fill level is always head - tail and indexing is a mask.
+ * Only the producer writes head and only the consumer writes tail, which makes it safe to share
+ * between one interrupt and the main loop without disabling interrupts.
+ *
+ * Rings with several producers (interrupts of any priority and the main loop) use Reserve / WriteAtPosition /
+ * CommitReserved instead. Space is claimed with an exclusive access on a word packing the reserved head and the
+ * number of writers still copying, and the last writer to finish publishes every reserved byte at once.
+ */
+
+#ifndef DRIVERS_RINGBUFFER_H_
+#define DRIVERS_RINGBUFFER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Positions are compared as signed 16 bit distances, which only holds up to half the counter range
+#define RING_BUFFER_MAX_CAPACITY 16384u
+
+typedef struct {
+	uint8_t* pBuffer;
+	uint16_t mask;				// capacity - 1
+	volatile uint16_t head;		// Producer position
+	volatile uint16_t tail;		// Consumer position
+	volatile uint32_t reservation;	// Multiple producers: reserved head in the low half, writers in progress in the high half
+} RingBuffer;
+
+typedef struct {
+	const uint8_t* pData;
+	uint16_t size;
+} RingBuffer_Span;
+
+// Capacity must be a power of two no larger than RING_BUFFER_MAX_CAPACITY
+bool RingBuffer_Init(RingBuffer* pRing, uint8_t* pBuffer, uint16_t capacity);
+void RingBuffer_Reset(RingBuffer* pRing);
+
+uint16_t RingBuffer_Capacity(const RingBuffer* pRing);
+uint16_t RingBuffer_Count(const RingBuffer* pRing);
+uint16_t RingBuffer_Free(const RingBuffer* pRing);
+
+// Producer side
+bool RingBuffer_Push(RingBuffer* pRing, uint8_t data);
+uint16_t RingBuffer_Write(RingBuffer* pRing, const uint8_t* pData, uint16_t size);
+void RingBuffer_Commit(RingBuffer* pRing, uint16_t size);	// Publishes bytes already placed in the storage (e.g. by the eDMA)
+
+// Multiple producers, safe from any context. Reserve returns the ring position of the claimed space, or false if it
+// does not fit. Every successful Reserve must be followed by CommitReserved once its data is in place
+bool RingBuffer_Reserve(RingBuffer* pRing, uint16_t size, uint16_t* pPosition);
+void RingBuffer_WriteAtPosition(RingBuffer* pRing, uint16_t position, const void* pData, uint16_t size);
+void RingBuffer_CommitReserved(RingBuffer* pRing);
+
+// Consumer side
+bool RingBuffer_Pop(RingBuffer* pRing, uint8_t* pData);
+uint16_t RingBuffer_Read(RingBuffer* pRing, uint8_t* pData, uint16_t size);
+uint16_t RingBuffer_PeekContiguous(const RingBuffer* pRing, const uint8_t** ppData);
+uint16_t RingBuffer_Peek(const RingBuffer* pRing, RingBuffer_Span* pFirst, RingBuffer_Span* pSecond);	// Whole content as up to two regions
+void RingBuffer_Consume(RingBuffer* pRing, uint16_t size);
+
+// Consumer side. If the producer lapped the consumer keep only the newest capacity bytes. Returns true if data was lost
+bool RingBuffer_DiscardOverrun(RingBuffer* pRing);
+
+#endif /* DRIVERS_RINGBUFFER_H_ */
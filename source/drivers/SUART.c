@@ -0,0 +1,507 @@
+/***************************************************************************//**
+  @file     SUART.c
+  @brief    Software UART driver
+  @author   Joaquin Torino
+ ******************************************************************************/
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include "SUART.h"
+#include <string.h>
+#include "hardware.h"
+#include "RingBuffer.h"
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+#define FTM_COUNT			4
+#define FTM_CHANNEL_COUNT	8
+
+// Delay from a write on an idle transmitter to the first timer match
+#define SUART_KICK_TICKS	100
+
+// Channel modes
+#define CHANNEL_CAPTURE_FALLING	(FTM_CnSC_ELSB_MASK)
+#define CHANNEL_COMPARE_ONLY	(FTM_CnSC_MSA_MASK)
+#define CHANNEL_SET_ON_MATCH	(FTM_CnSC_MSA_MASK | FTM_CnSC_ELSB_MASK | FTM_CnSC_ELSA_MASK)
+#define CHANNEL_CLEAR_ON_MATCH	(FTM_CnSC_MSA_MASK | FTM_CnSC_ELSB_MASK)
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+typedef struct {
+	pin_t pin;
+	uint8_t ftm;
+	uint8_t channel;
+	uint8_t mux;
+} SUARTPinMap;
+
+typedef struct {
+	bool used;
+	pin_t rx;
+	pin_t tx;
+	const SUARTPinMap* pRxMap;
+	const SUARTPinMap* pTxMap;
+
+	uint16_t bitTicks;			// Bus clock cycles per bit
+	uint8_t numDataBits;
+	bool parity;
+	uint8_t frameBits;			// Start, data, parity and stop
+	uint8_t maxRunBits;			// Longest run that fits in one wrap of the 16 bit counter
+
+	RingBuffer receiveRing;
+	RingBuffer transmitRing;
+	uint8_t receiveBuffer[SUART_BUFFER_SIZE];
+	uint8_t transmitBuffer[SUART_BUFFER_SIZE];
+
+	// Transmitter. Runs of equal bits share a single timer match
+	volatile bool txActive;
+	uint16_t txFrame;			// Bits still to go out, LSB first
+	uint8_t txBitsLeft;
+	uint8_t txRunBits;			// Length of the run started by the current match, 0 while guarding the stop bit
+
+	// Receiver
+	bool rxSampling;
+	uint16_t rxFrame;
+	uint8_t rxBitIndex;
+
+	SUART_Stats stats;
+} SUART;
+
+typedef struct {
+	SUART* pSUART;
+	bool isReceiver;
+} SUARTChannel;
+
+/*******************************************************************************
+ * VARIABLES WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+static SUART suarts[SUART_MAX_CHANNELS];
+static SUARTChannel channels[FTM_COUNT][FTM_CHANNEL_COUNT];
+static bool ftmInitialized[FTM_COUNT];
+
+static FTM_Type* const ftmRegisters[FTM_COUNT] = FTM_BASE_PTRS;
+static const IRQn_Type ftmIRQs[FTM_COUNT] = FTM_IRQS;
+
+// FlexTimer channels reachable from the pins. FTM1 and FTM2 only have two channels and are left for other uses
+static const SUARTPinMap pinMaps[] = {
+		{ PORTNUM2PIN(PA, 0), 0, 5, 3 }, { PORTNUM2PIN(PA, 1), 0, 6, 3 }, { PORTNUM2PIN(PA, 2), 0, 7, 3 },
+		{ PORTNUM2PIN(PA, 3), 0, 0, 3 }, { PORTNUM2PIN(PA, 4), 0, 1, 3 }, { PORTNUM2PIN(PA, 5), 0, 2, 3 },
+		{ PORTNUM2PIN(PA, 6), 0, 3, 3 }, { PORTNUM2PIN(PA, 7), 0, 4, 3 },
+		{ PORTNUM2PIN(PC, 1), 0, 0, 4 }, { PORTNUM2PIN(PC, 2), 0, 1, 4 }, { PORTNUM2PIN(PC, 3), 0, 2, 4 },
+		{ PORTNUM2PIN(PC, 4), 0, 3, 4 }, { PORTNUM2PIN(PD, 4), 0, 4, 4 }, { PORTNUM2PIN(PD, 5), 0, 5, 4 },
+		{ PORTNUM2PIN(PD, 6), 0, 6, 4 }, { PORTNUM2PIN(PD, 7), 0, 7, 4 },
+		{ PORTNUM2PIN(PD, 0), 3, 0, 4 }, { PORTNUM2PIN(PD, 1), 3, 1, 4 }, { PORTNUM2PIN(PD, 2), 3, 2, 4 },
+		{ PORTNUM2PIN(PD, 3), 3, 3, 4 }, { PORTNUM2PIN(PC, 8), 3, 4, 3 }, { PORTNUM2PIN(PC, 9), 3, 5, 3 },
+		{ PORTNUM2PIN(PC, 10), 3, 6, 3 }, { PORTNUM2PIN(PC, 11), 3, 7, 3 },
+		{ PORTNUM2PIN(PE, 5), 3, 0, 6 }, { PORTNUM2PIN(PE, 6), 3, 1, 6 }, { PORTNUM2PIN(PE, 7), 3, 2, 6 },
+		{ PORTNUM2PIN(PE, 8), 3, 3, 6 }, { PORTNUM2PIN(PE, 9), 3, 4, 6 }, { PORTNUM2PIN(PE, 10), 3, 5, 6 },
+		{ PORTNUM2PIN(PE, 11), 3, 6, 6 }, { PORTNUM2PIN(PE, 12), 3, 7, 6 }
+};
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS WITH LOCAL SCOPE
+ ******************************************************************************/
+
+static inline uint32_t SUART_EnterCritical()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static inline void SUART_ExitCritical(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+static uint32_t SUART_GetBusClock()
+{
+	uint32_t outdiv1 = (SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT;
+	uint32_t outdiv2 = (SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV2_MASK) >> SIM_CLKDIV1_OUTDIV2_SHIFT;
+	return (uint32_t)(((uint64_t)__CORE_CLOCK__ * (outdiv1 + 1)) / (outdiv2 + 1));
+}
+
+static const SUARTPinMap* SUART_FindPin(pin_t pin)
+{
+	for (uint8_t i = 0; i < sizeof(pinMaps) / sizeof(pinMaps[0]); i++)
+	{
+		if (pinMaps[i].pin == pin)
+			return &pinMaps[i];
+	}
+	return 0;
+}
+
+// Moving a channel between input capture and output compare needs it disabled (ELSB:ELSA = 00) in between.
+// Output compare channels only change their match action and are written directly, disabling them would hand
+// the pin back to the port for a moment
+static inline void SUART_SetChannelMode(FTM_Type* pFTM, uint8_t ch, uint32_t mode)
+{
+	pFTM->CONTROLS[ch].CnSC = 0;
+	pFTM->CONTROLS[ch].CnSC = mode;
+}
+
+static void SUART_InitTimer(uint8_t ftm)
+{
+	if (ftmInitialized[ftm])
+		return;
+
+	if (ftm == 0)
+		SIM->SCGC6 |= SIM_SCGC6_FTM0(1);
+	else
+		SIM->SCGC3 |= SIM_SCGC3_FTM3(1);
+
+	// Free running 16 bit counter on the bus clock. Every channel schedules its own matches on it
+	FTM_Type* pFTM = ftmRegisters[ftm];
+	pFTM->SC = 0;
+	pFTM->CNTIN = 0;
+	pFTM->MOD = 0xFFFF;
+	pFTM->CNT = 0;
+	pFTM->SC = FTM_SC_CLKS(1) | FTM_SC_PS(0);
+
+	NVIC_EnableIRQ(ftmIRQs[ftm]);
+	ftmInitialized[ftm] = true;
+}
+
+static uint16_t SUART_EncodeFrame(const SUART* pSUART, uint8_t data)
+{
+	data &= (1u << pSUART->numDataBits) - 1;
+
+	// Start bit low, data LSB first, even parity, stop bit high
+	uint16_t frame = (uint16_t)data << 1;
+	uint8_t stopIndex = 1 + pSUART->numDataBits;
+	if (pSUART->parity)
+	{
+		frame |= (uint16_t)__builtin_parity(data) << stopIndex;
+		stopIndex++;
+	}
+	frame |= 1u << stopIndex;
+	return frame;
+}
+
+// Takes the next run of equal bits. Returns its length, 0 if there is nothing left to send
+static uint8_t SUART_NextRun(SUART* pSUART, bool* pLevel)
+{
+	if (pSUART->txBitsLeft == 0)
+	{
+		uint8_t data;
+		if (!RingBuffer_Pop(&pSUART->transmitRing, &data))
+			return 0;
+
+		pSUART->txFrame = SUART_EncodeFrame(pSUART, data);
+		pSUART->txBitsLeft = pSUART->frameBits;
+		pSUART->stats.bytesTransmitted++;
+	}
+
+	bool level = pSUART->txFrame & 1;
+	uint8_t run = 0;
+	while (pSUART->txBitsLeft > 0 && run < pSUART->maxRunBits && (bool)(pSUART->txFrame & 1) == level)
+	{
+		pSUART->txFrame >>= 1;
+		pSUART->txBitsLeft--;
+		run++;
+	}
+
+	*pLevel = level;
+	return run;
+}
+
+// The level programmed for this match just reached the pin. Schedule the end of its run
+static void SUART_TransmitMatch_Impl(SUART* pSUART)
+{
+	FTM_Type* pFTM = ftmRegisters[pSUART->pTxMap->ftm];
+	uint8_t ch = pSUART->pTxMap->channel;
+
+	// After the stop bit guard the next start bit goes one bit later
+	uint16_t nextMatch = pFTM->CONTROLS[ch].CnV + (pSUART->txRunBits ? pSUART->txRunBits : 1) * pSUART->bitTicks;
+
+	bool level;
+	uint8_t run = SUART_NextRun(pSUART, &level);
+	if (run == 0)
+	{
+		if (pSUART->txRunBits == 0)
+		{
+			// Stop bit done and nothing queued, the line idles high
+			pFTM->CONTROLS[ch].CnSC = CHANNEL_SET_ON_MATCH;
+			pSUART->txActive = false;
+			return;
+		}
+
+		// One more match at the end of the stop bit so a new byte can not cut it short
+		pFTM->CONTROLS[ch].CnSC = CHANNEL_SET_ON_MATCH | FTM_CnSC_CHIE_MASK;
+		pFTM->CONTROLS[ch].CnV = nextMatch;
+		pSUART->txRunBits = 0;
+		return;
+	}
+
+	pFTM->CONTROLS[ch].CnSC = (level ? CHANNEL_SET_ON_MATCH : CHANNEL_CLEAR_ON_MATCH) | FTM_CnSC_CHIE_MASK;
+	pFTM->CONTROLS[ch].CnV = nextMatch;
+	pSUART->txRunBits = run;
+}
+
+static void SUART_WaitStartBit(SUART* pSUART)
+{
+	FTM_Type* pFTM = ftmRegisters[pSUART->pRxMap->ftm];
+	SUART_SetChannelMode(pFTM, pSUART->pRxMap->channel, CHANNEL_CAPTURE_FALLING | FTM_CnSC_CHIE_MASK);
+	pSUART->rxSampling = false;
+}
+
+static void SUART_ReceiveMatch_Impl(SUART* pSUART)
+{
+	FTM_Type* pFTM = ftmRegisters[pSUART->pRxMap->ftm];
+	uint8_t ch = pSUART->pRxMap->channel;
+
+	if (!pSUART->rxSampling)
+	{
+		// Falling edge captured. Sample in the middle of every bit from now on, the pin is read through the port
+		uint16_t edge = pFTM->CONTROLS[ch].CnV;
+		SUART_SetChannelMode(pFTM, ch, CHANNEL_COMPARE_ONLY | FTM_CnSC_CHIE_MASK);
+		pFTM->CONTROLS[ch].CnV = edge + pSUART->bitTicks / 2;
+		pSUART->rxSampling = true;
+		pSUART->rxFrame = 0;
+		pSUART->rxBitIndex = 0;
+		return;
+	}
+
+	bool level = gpioRead(pSUART->rx);
+	if (pSUART->rxBitIndex == 0 && level)
+	{
+		// The start bit did not hold, it was a glitch
+		SUART_WaitStartBit(pSUART);
+		return;
+	}
+
+	pSUART->rxFrame |= (uint16_t)level << pSUART->rxBitIndex;
+	pSUART->rxBitIndex++;
+	if (pSUART->rxBitIndex < pSUART->frameBits)
+	{
+		pFTM->CONTROLS[ch].CnV += pSUART->bitTicks;
+		return;
+	}
+
+	// Middle of the stop bit, the next start bit can not come before the end of it
+	SUART_WaitStartBit(pSUART);
+
+	uint8_t data = (pSUART->rxFrame >> 1) & ((1u << pSUART->numDataBits) - 1);
+	if (!level)
+	{
+		pSUART->stats.framingErrors++;
+		return;
+	}
+	if (pSUART->parity && ((pSUART->rxFrame >> (1 + pSUART->numDataBits)) & 1) != __builtin_parity(data))
+	{
+		pSUART->stats.parityErrors++;
+		return;
+	}
+
+	if (RingBuffer_Push(&pSUART->receiveRing, data))
+		pSUART->stats.bytesReceived++;
+	else
+		pSUART->stats.droppedBytes++;
+}
+
+static void FTMX_IRQImpl(uint8_t ftm)
+{
+	FTM_Type* pFTM = ftmRegisters[ftm];
+	uint32_t status = pFTM->STATUS;
+
+	for (uint8_t ch = 0; ch < FTM_CHANNEL_COUNT; ch++)
+	{
+		if (!(status & (1u << ch)))
+			continue;
+
+		// CHF is cleared by reading it set and writing a 0
+		pFTM->CONTROLS[ch].CnSC &= ~FTM_CnSC_CHF_MASK;
+
+		SUARTChannel* pChannel = &channels[ftm][ch];
+		if (pChannel->pSUART == 0)
+			continue;
+
+		uint32_t start = DWT->CYCCNT;
+		if (pChannel->isReceiver)
+			SUART_ReceiveMatch_Impl(pChannel->pSUART);
+		else
+			SUART_TransmitMatch_Impl(pChannel->pSUART);
+
+		pChannel->pSUART->stats.interrupts++;
+		pChannel->pSUART->stats.isrCycles += DWT->CYCCNT - start;
+	}
+}
+
+/*******************************************************************************
+ * FUNCTION DEFINITIONS WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+SUART_Handle SUART_Init (pin_t rx, pin_t tx, uint16_t baudRate)
+{
+	return SUART_InitEx(rx, tx, baudRate, 8, false);
+}
+
+SUART_Handle SUART_InitEx (pin_t rx, pin_t tx, uint16_t baudRate, uint8_t numDataBits, bool parity)
+{
+	if (baudRate == 0 || numDataBits < 5 || numDataBits > 8)
+		return -1;
+
+	const SUARTPinMap* pRxMap = SUART_FindPin(rx);
+	const SUARTPinMap* pTxMap = SUART_FindPin(tx);
+	// Different pins can reach the same channel (PTA0 and PTD5 are both FTM0 CH5)
+	if (pRxMap == 0 || pTxMap == 0 || (pRxMap->ftm == pTxMap->ftm && pRxMap->channel == pTxMap->channel))
+		return -1;
+	if (channels[pRxMap->ftm][pRxMap->channel].pSUART || channels[pTxMap->ftm][pTxMap->channel].pSUART)
+		return -1;
+
+	// Bit times must fit the 16 bit counter and leave time to serve the interrupt
+	uint32_t bitTicks = (SUART_GetBusClock() + baudRate / 2) / baudRate;
+	if (bitTicks < SUART_MIN_BIT_TICKS || bitTicks > 0xFFFF)
+		return -1;
+
+	SUART_Handle handle = -1;
+	for (SUART_Handle i = 0; i < SUART_MAX_CHANNELS; i++)
+	{
+		if (!suarts[i].used)
+		{
+			handle = i;
+			break;
+		}
+	}
+	if (handle < 0)
+		return -1;
+
+	SUART* pSUART = &suarts[handle];
+	memset(pSUART, 0, sizeof(SUART));
+	pSUART->used = true;
+	pSUART->rx = rx;
+	pSUART->tx = tx;
+	pSUART->pRxMap = pRxMap;
+	pSUART->pTxMap = pTxMap;
+	pSUART->bitTicks = (uint16_t)bitTicks;
+	pSUART->numDataBits = numDataBits;
+	pSUART->parity = parity;
+	pSUART->frameBits = 1 + numDataBits + parity + 1;
+	pSUART->maxRunBits = 0xFFFF / bitTicks;
+	RingBuffer_Init(&pSUART->receiveRing, pSUART->receiveBuffer, SUART_BUFFER_SIZE);
+	RingBuffer_Init(&pSUART->transmitRing, pSUART->transmitBuffer, SUART_BUFFER_SIZE);
+
+	// Cycle counter for the cost per byte
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	SUART_InitTimer(pRxMap->ftm);
+	SUART_InitTimer(pTxMap->ftm);
+
+	// Transmit line idles high. The port drives it until a forced match has set the channel output, so neither the
+	// line nor the other channels of the timer see a glitch (MODE INIT would reload every channel output)
+	gpioMode(tx, INPUT_PULLUP);
+	gpioWrite(tx, HIGH);
+	gpioMode(tx, OUTPUT);
+	FTM_Type* pTxFTM = ftmRegisters[pTxMap->ftm];
+	uint8_t txChannel = pTxMap->channel;
+	SUART_SetChannelMode(pTxFTM, txChannel, CHANNEL_SET_ON_MATCH);
+	pTxFTM->CONTROLS[txChannel].CnV = (uint16_t)(pTxFTM->CNT + SUART_KICK_TICKS);
+	while (!(pTxFTM->CONTROLS[txChannel].CnSC & FTM_CnSC_CHF_MASK))
+	{
+		// Another channel's interrupt may clear the flag, the match then comes again on the next counter wrap
+	}
+	pTxFTM->CONTROLS[txChannel].CnSC &= ~FTM_CnSC_CHF_MASK;
+	channels[pTxMap->ftm][pTxMap->channel].pSUART = pSUART;
+	channels[pTxMap->ftm][pTxMap->channel].isReceiver = false;
+	gpioMux(tx, pTxMap->mux);
+
+	gpioMode(rx, INPUT_PULLUP);
+	gpioMux(rx, pRxMap->mux);
+	channels[pRxMap->ftm][pRxMap->channel].pSUART = pSUART;
+	channels[pRxMap->ftm][pRxMap->channel].isReceiver = true;
+	SUART_WaitStartBit(pSUART);
+
+	return handle;
+}
+
+uint16_t SUART_PollNewData(SUART_Handle handle)
+{
+	return RingBuffer_Count(&suarts[handle].receiveRing);
+}
+
+uint16_t SUART_ReadData(SUART_Handle handle, uint8_t* pFillData, uint16_t size)
+{
+	return RingBuffer_Read(&suarts[handle].receiveRing, pFillData, size);
+}
+
+bool SUART_WriteData(SUART_Handle handle, const uint8_t* pData, uint16_t size)
+{
+	SUART* pSUART = &suarts[handle];
+
+	uint32_t primask = SUART_EnterCritical();
+	if (RingBuffer_Free(&pSUART->transmitRing) < size)
+	{
+		SUART_ExitCritical(primask);
+		return false;
+	}
+	RingBuffer_Write(&pSUART->transmitRing, pData, size);
+
+	if (!pSUART->txActive)
+	{
+		// Start from the stop bit guard, its match loads the first byte
+		FTM_Type* pFTM = ftmRegisters[pSUART->pTxMap->ftm];
+		uint8_t ch = pSUART->pTxMap->channel;
+		pSUART->txRunBits = 0;
+		pSUART->txActive = true;
+		pFTM->CONTROLS[ch].CnV = (uint16_t)(pFTM->CNT + SUART_KICK_TICKS);
+		// The idle channel kept matching on every counter wrap, drop the stale flag before enabling the interrupt
+		(void)pFTM->CONTROLS[ch].CnSC;
+		pFTM->CONTROLS[ch].CnSC = CHANNEL_SET_ON_MATCH | FTM_CnSC_CHIE_MASK;
+	}
+	SUART_ExitCritical(primask);
+	return true;
+}
+
+void SUART_GetStats(SUART_Handle handle, SUART_Stats* pStats)
+{
+	uint32_t primask = SUART_EnterCritical();
+	*pStats = suarts[handle].stats;
+	SUART_ExitCritical(primask);
+}
+
+uint32_t SUART_GetCyclesPerByte(SUART_Handle handle)
+{
+	SUART_Stats stats;
+	SUART_GetStats(handle, &stats);
+
+	uint32_t bytes = stats.bytesReceived + stats.bytesTransmitted;
+	return bytes ? stats.isrCycles / bytes : 0;
+}
+
+void SUART_Delete(SUART_Handle handle)
+{
+	SUART* pSUART = &suarts[handle];
+	if (!pSUART->used)
+		return;
+
+	uint32_t primask = SUART_EnterCritical();
+	ftmRegisters[pSUART->pRxMap->ftm]->CONTROLS[pSUART->pRxMap->channel].CnSC = 0;
+	ftmRegisters[pSUART->pTxMap->ftm]->CONTROLS[pSUART->pTxMap->channel].CnSC = 0;
+	channels[pSUART->pRxMap->ftm][pSUART->pRxMap->channel].pSUART = 0;
+	channels[pSUART->pTxMap->ftm][pSUART->pTxMap->channel].pSUART = 0;
+	pSUART->used = false;
+	SUART_ExitCritical(primask);
+
+	// Back to plain GPIO
+	gpioMux(pSUART->rx, 1);
+	gpioMux(pSUART->tx, 1);
+}
+
+#define FTMX_IRQ_IMPL(x)				\
+__ISR__ FTM##x##_IRQHandler(void)		\
+{										\
+	FTMX_IRQImpl(x);					\
+}
+
+FTMX_IRQ_IMPL(0)
+FTMX_IRQ_IMPL(3)
+
+/*******************************************************************************
+ ******************************************************************************/
@@ -23,11 +23,28 @@
  * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
  ******************************************************************************/
 
+// Bit timing comes from FlexTimer output compare (TX) and input capture plus compare sampling (RX).
+// Usable on the FTM0 and FTM3 channel pins, one channel per direction
+
+#define SUART_MAX_CHANNELS		4
+#define SUART_BUFFER_SIZE		64		// Receive and transmit ring of every channel
+#define SUART_MIN_BIT_TICKS		400		// Shortest bit in bus clock cycles, leaves room for the interrupt latency
+
 
 /*******************************************************************************
  * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
  ******************************************************************************/
 
+typedef struct {
+	uint32_t bytesReceived;
+	uint32_t bytesTransmitted;
+	uint32_t framingErrors;
+	uint32_t parityErrors;
+	uint32_t droppedBytes;		// Received bytes lost because the receive ring was full
+	uint32_t interrupts;
+	uint32_t isrCycles;			// Core cycles spent in the timer interrupts of this channel
+} SUART_Stats;
+
 /*******************************************************************************
  * VARIABLE PROTOTYPES WITH GLOBAL SCOPE
  ******************************************************************************/
@@ -38,9 +55,20 @@
 
 typedef int8_t SUART_Handle;
 
+// 8 data bits, no parity. Returns -1 if a pin has no FlexTimer channel, it is taken or the rate is too high
 SUART_Handle SUART_Init (pin_t rx, pin_t tx, uint16_t baudRate);
+// 5 to 8 data bits, parity is even
 SUART_Handle SUART_InitEx (pin_t rx, pin_t tx, uint16_t baudRate, uint8_t numDataBits, bool parity);
 
+uint16_t SUART_PollNewData(SUART_Handle handle);
+uint16_t SUART_ReadData(SUART_Handle handle, uint8_t* pFillData, uint16_t size);
+// Queues all the data or nothing if it does not fit
+bool SUART_WriteData(SUART_Handle handle, const uint8_t* pData, uint16_t size);
+
+void SUART_GetStats(SUART_Handle handle, SUART_Stats* pStats);
+// Interrupt cost of every byte moved so far
+uint32_t SUART_GetCyclesPerByte(SUART_Handle handle);
+
 void SUART_Delete(SUART_Handle handle);
 
 /*******************************************************************************
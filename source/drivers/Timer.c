@@ -9,105 +9,437 @@
  ******************************************************************************/
 #include "Timer.h"
 #include "SysTick.h"
+#include "hardware.h"
 #include <stdlib.h>
+#include <string.h>
 
 /*******************************************************************************
  *                                  MACROS
  ******************************************************************************/
 #define INITIAL_SERVICE_CAPACITY 16u
 
+// heapIndex of a disabled service
+#define NOT_QUEUED UINT32_MAX
+
+#define CYCLES_PER_MICROSECOND (__CORE_CLOCK__ / 1000000u)
+
+#ifdef TIMER_TICKLESS
+// PIT channels 0 and 1 chained into a free running 64 bit count of bus cycles, channel 2 fires at the next deadline
+#define TIMER_PIT_CLOCK_LOW		0
+#define TIMER_PIT_CLOCK_HIGH	1
+#define TIMER_PIT_DEADLINE		2
+// Shortest one-shot, for deadlines already due
+#define TIMER_MIN_ARM_CYCLES	64u
+#else
+// SysTick runs on the core clock and reloads once per tick
+#define CYCLES_PER_TICK (uint32_t)(__CORE_CLOCK__ / TICKS_PER_SECOND)
+#endif
+
 /*******************************************************************************
  *                                  OBJETOS
  ******************************************************************************/
 typedef struct
 {
-	callback* pCallback;
-	ticks tickInterval;
-	ticks tickCount;
+	callback* pCallback;		// Null for a free slot
+	ticks period;
+	ticks deadline;				// Absolute tick of the next call
 	void* user_data;
-	bool enable;
+	uint32_t heapIndex;
+	bool oneShot;				// Disarmed once called
+	bool deferred;				// Called from TimerRunDeferred
 } PeriodicService;
 
+typedef struct
+{
+	callback* pCallback;
+	void* user_data;
+} DeferredWork;
+
 /*******************************************************************************
  *                                 VARIABLES
  ******************************************************************************/
 static PeriodicService* pServices;
 static uint32_t registeredServicesCount;
 static uint32_t maxCapacity;
-static ticks current_ticks = 0;
+static volatile ticks current_ticks = 0;
+
+// Min-heap of the enabled services keyed on their deadline, the tick only looks at the top
+static service_id* pHeap;
+static uint32_t heapSize;
+
+static TimerStats stats;
+
+// Posted from any context, drained by the main loop. Oldest at deferredTail
+static DeferredWork deferredQueue[TIMER_DEFERRED_QUEUE_SIZE];
+static volatile uint8_t deferredHead;
+static volatile uint8_t deferredTail;
+
+#ifdef TIMER_TICKLESS
+static uint32_t busClock;			// PIT runs on the bus clock
+static uint32_t cyclesPerTick;
+#endif
 
 /*******************************************************************************
  *                                FUNCIONES
  ******************************************************************************/
-void TimerPISR()
+static inline uint32_t TimerEnterCritical()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static inline void TimerExitCritical(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+// Services due on the same tick run in the order they were registered
+static inline bool TimerBefore(service_id a, service_id b)
+{
+	return pServices[a].deadline < pServices[b].deadline || (pServices[a].deadline == pServices[b].deadline && a < b);
+}
+
+static inline void TimerHeapPlace(uint32_t index, service_id serviceId)
+{
+	pHeap[index] = serviceId;
+	pServices[serviceId].heapIndex = index;
+}
+
+static void TimerSiftUp(uint32_t index)
 {
-	for (int i = 0; i < registeredServicesCount; i++)
+	service_id serviceId = pHeap[index];
+	while (index > 0)
 	{
-		PeriodicService* pService = &pServices[i];
-		if (!pService->enable)
-			continue;
-		if (pService->tickCount == 0)
+		uint32_t parent = (index - 1) / 2;
+		if (!TimerBefore(serviceId, pHeap[parent]))
+			break;
+		TimerHeapPlace(index, pHeap[parent]);
+		index = parent;
+	}
+	TimerHeapPlace(index, serviceId);
+}
+
+static void TimerSiftDown(uint32_t index)
+{
+	service_id serviceId = pHeap[index];
+	while (1)
+	{
+		uint32_t child = 2 * index + 1;
+		if (child >= heapSize)
+			break;
+		if (child + 1 < heapSize && TimerBefore(pHeap[child + 1], pHeap[child]))
+			child++;
+		if (!TimerBefore(pHeap[child], serviceId))
+			break;
+		TimerHeapPlace(index, pHeap[child]);
+		index = child;
+	}
+	TimerHeapPlace(index, serviceId);
+}
+
+static void TimerSchedule(service_id serviceId, ticks deadline)
+{
+	pServices[serviceId].deadline = deadline;
+	pHeap[heapSize] = serviceId;
+	pServices[serviceId].heapIndex = heapSize;
+	TimerSiftUp(heapSize++);
+}
+
+static void TimerCancel(service_id serviceId)
+{
+	uint32_t index = pServices[serviceId].heapIndex;
+	if (index == NOT_QUEUED)
+		return;
+
+	pServices[serviceId].heapIndex = NOT_QUEUED;
+	service_id last = pHeap[--heapSize];
+	if (index == heapSize)
+		return;
+
+	// The last entry takes the hole and moves whichever way its deadline says
+	TimerHeapPlace(index, last);
+	TimerSiftUp(index);
+	TimerSiftDown(pServices[last].heapIndex);
+}
+
+#ifdef TIMER_TICKLESS
+// Bus cycles since TimerInit. The high half is read on both sides of the low one so a carry in between is not missed
+static uint64_t TimerCycles()
+{
+	uint32_t high = PIT->CHANNEL[TIMER_PIT_CLOCK_HIGH].CVAL;
+	uint32_t low = PIT->CHANNEL[TIMER_PIT_CLOCK_LOW].CVAL;
+	uint32_t highAgain = PIT->CHANNEL[TIMER_PIT_CLOCK_HIGH].CVAL;
+	if (high != highAgain)
+	{
+		high = highAgain;
+		low = PIT->CHANNEL[TIMER_PIT_CLOCK_LOW].CVAL;
+	}
+
+	// Both channels count down from all ones
+	return ~(((uint64_t)high << 32) | low);
+}
+
+static ticks TimerNow()
+{
+	return TimerCycles() / cyclesPerTick;
+}
+
+// Whole seconds apart so the product never overflows
+static uint64_t TimerCoreCycles()
+{
+	uint64_t cycles = TimerCycles();
+	return (cycles / busClock) * __CORE_CLOCK__ + (cycles % busClock) * __CORE_CLOCK__ / busClock;
+}
+
+// Programs the one-shot for the earliest deadline. With nothing enabled the timer stays off and never interrupts
+static void TimerArm()
+{
+	PIT->CHANNEL[TIMER_PIT_DEADLINE].TCTRL = 0;
+	PIT->CHANNEL[TIMER_PIT_DEADLINE].TFLG = PIT_TFLG_TIF_MASK;
+	if (heapSize == 0)
+		return;
+
+	uint64_t target = pServices[pHeap[0]].deadline * cyclesPerTick;
+	uint64_t now = TimerCycles();
+	uint64_t delay = target > now + TIMER_MIN_ARM_CYCLES ? target - now : TIMER_MIN_ARM_CYCLES;
+
+	// Deadlines past the 32 bit range take more than one shot, the early interrupt only re-arms
+	PIT->CHANNEL[TIMER_PIT_DEADLINE].LDVAL = (uint32_t)(delay > UINT32_MAX ? UINT32_MAX : delay - 1);
+	PIT->CHANNEL[TIMER_PIT_DEADLINE].TCTRL = PIT_TCTRL_TIE_MASK | PIT_TCTRL_TEN_MASK;
+}
+#else
+// The tick interrupt may update the count between its two halves, read it until two reads agree
+static ticks TimerNow()
+{
+	ticks first, second;
+	do
+	{
+		first = current_ticks;
+		second = current_ticks;
+	} while (first != second);
+	return first;
+}
+
+static uint64_t TimerCoreCycles()
+{
+	ticks tick, after;
+	uint32_t elapsed;
+	do
+	{
+		tick = TimerNow();
+		elapsed = CYCLES_PER_TICK - 1 - SysTick->VAL;
+
+		// Reloaded with the interrupt still pending (masked, or called from a higher priority handler),
+		// the count is one tick behind the counter. VAL is read again so it is surely past the reload
+		if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
 		{
-			pService->tickCount = pService->tickInterval;
-			pService->pCallback(pService->user_data);
+			elapsed = CYCLES_PER_TICK - 1 - SysTick->VAL;
+			tick++;
+		}
+
+		// Read again if the tick interrupt ran in between and the pair no longer matches
+		after = TimerNow();
+	} while (after != tick && after + 1 != tick);
+	return tick * CYCLES_PER_TICK + elapsed;
+}
+
+// The tick checks the heap every millisecond, nothing to program
+static inline void TimerArm()
+{
+}
+#endif
+
+// Runs the services due at now. Only the expired ones are visited, the rest of the heap is not touched
+static void TimerExpire(ticks now)
+{
+	while (heapSize != 0 && pServices[pHeap[0]].deadline <= now)
+	{
+		service_id serviceId = pHeap[0];
+		PeriodicService* pService = &pServices[serviceId];
+
+		// Rescheduled before the call so the callback can disable or re-arm itself. Missed periods are skipped
+		if (pService->oneShot)
+		{
+			TimerCancel(serviceId);
 		}
 		else
 		{
-			pService->tickCount--;
+			pService->deadline += pService->period;
+			if (pService->deadline <= now)
+				pService->deadline = now + pService->period;
+			TimerSiftDown(0);
 		}
+
+		stats.callbacks++;
+		if (pService->deferred)
+			TimerPostDeferred(pService->pCallback, pService->user_data);
+		else
+			pService->pCallback(pService->user_data);
 	}
+}
+
+static inline void TimerAccountCycles(uint32_t start)
+{
+	uint32_t cycles = DWT->CYCCNT - start;
+	stats.isrCycles += cycles;
+	if (cycles > stats.isrMaxCycles)
+		stats.isrMaxCycles = cycles;
+}
+
+#ifdef TIMER_TICKLESS
+__ISR__ PIT2_IRQHandler(void)
+{
+	uint32_t start = DWT->CYCCNT;
+	stats.interrupts++;
+
+	TimerExpire(TimerNow());
+	TimerArm();
+
+	TimerAccountCycles(start);
+}
+#else
+void TimerPISR()
+{
+	uint32_t start = DWT->CYCCNT;
 	current_ticks++;
+	stats.interrupts++;
+
+	TimerExpire(current_ticks);
+
+	TimerAccountCycles(start);
 }
+#endif
 
 bool TimerInit()
 {
+	// Cycle counter for the interrupt statistics
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+#ifdef TIMER_TICKLESS
+	uint32_t outdiv1 = (SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT;
+	uint32_t outdiv2 = (SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV2_MASK) >> SIM_CLKDIV1_OUTDIV2_SHIFT;
+	busClock = (uint32_t)(((uint64_t)__CORE_CLOCK__ * (outdiv1 + 1)) / (outdiv2 + 1));
+	cyclesPerTick = busClock / TICKS_PER_SECOND;
+
+	SIM->SCGC6 |= SIM_SCGC6_PIT(1);
+	// Stopped while the debugger halts the core, like SysTick
+	PIT->MCR = PIT_MCR_FRZ(1);
+
+	// The high channel counts the wraps of the low one
+	PIT->CHANNEL[TIMER_PIT_CLOCK_HIGH].TCTRL = 0;
+	PIT->CHANNEL[TIMER_PIT_CLOCK_HIGH].LDVAL = UINT32_MAX;
+	PIT->CHANNEL[TIMER_PIT_CLOCK_HIGH].TCTRL = PIT_TCTRL_CHN_MASK | PIT_TCTRL_TEN_MASK;
+	PIT->CHANNEL[TIMER_PIT_CLOCK_LOW].TCTRL = 0;
+	PIT->CHANNEL[TIMER_PIT_CLOCK_LOW].LDVAL = UINT32_MAX;
+	PIT->CHANNEL[TIMER_PIT_CLOCK_LOW].TCTRL = PIT_TCTRL_TEN_MASK;
+
+	NVIC_EnableIRQ(PIT2_IRQn);
+	uint32_t primask = TimerEnterCritical();
+	TimerArm();
+	TimerExitCritical(primask);
+	return true;
+#else
 	// Init systick
 	return SysTick_Init(&TimerPISR, (uint64_t)TICKS_PER_SECOND);
+#endif
 }
 
-service_id TimerRegisterPeriodicInterruption(callback* pCallback, ticks deltaT, void* user_data)
+// Takes a free slot, with interrupts already masked. The tick interrupt walks both arrays
+static service_id TimerAllocate(callback* pCallback, ticks period, void* user_data)
 {
-	if (maxCapacity == 0)
+	// Slots of unregistered services are reused, the ids of the others never change
+	service_id serviceId = 0;
+	while (serviceId < registeredServicesCount && pServices[serviceId].pCallback != 0)
 	{
-		pServices = (PeriodicService*)malloc(sizeof(PeriodicService) * INITIAL_SERVICE_CAPACITY);
-		maxCapacity = INITIAL_SERVICE_CAPACITY;
+		serviceId++;
 	}
 
-	if (registeredServicesCount >= maxCapacity)
+	if (serviceId == registeredServicesCount)
 	{
-		maxCapacity = maxCapacity << 1;
-		pServices = (PeriodicService*)realloc(pServices, sizeof(PeriodicService) * maxCapacity);
+		if (maxCapacity == 0)
+		{
+			pServices = (PeriodicService*)malloc(sizeof(PeriodicService) * INITIAL_SERVICE_CAPACITY);
+			pHeap = (service_id*)malloc(sizeof(service_id) * INITIAL_SERVICE_CAPACITY);
+			maxCapacity = INITIAL_SERVICE_CAPACITY;
+		}
+
+		if (registeredServicesCount >= maxCapacity)
+		{
+			maxCapacity = maxCapacity << 1;
+			pServices = (PeriodicService*)realloc(pServices, sizeof(PeriodicService) * maxCapacity);
+			pHeap = (service_id*)realloc(pHeap, sizeof(service_id) * maxCapacity);
+		}
+		registeredServicesCount++;
 	}
 
-	PeriodicService* pService = &pServices[registeredServicesCount];
+	PeriodicService* pService = &pServices[serviceId];
 
 	pService->pCallback = pCallback;
-	pService->tickInterval = deltaT - 1;
-	pService->tickCount = 0;
+	pService->period = period != 0 ? period : 1;
 	pService->user_data = user_data;
-	pService->enable = 1;
+	pService->oneShot = false;
+	pService->deferred = false;
+	pService->heapIndex = NOT_QUEUED;
+	return serviceId;
+}
+
+service_id TimerRegisterPeriodicInterruption(callback* pCallback, ticks deltaT, void* user_data)
+{
+	uint32_t primask = TimerEnterCritical();
+	service_id serviceId = TimerAllocate(pCallback, deltaT, user_data);
 
-	return registeredServicesCount++;
+	// First call on the next tick
+	TimerSchedule(serviceId, TimerNow() + 1);
+	TimerArm();
+
+	TimerExitCritical(primask);
+	return serviceId;
+}
+
+service_id TimerRegisterOneShot(callback* pCallback, ticks delay, void* user_data)
+{
+	uint32_t primask = TimerEnterCritical();
+	service_id serviceId = TimerAllocate(pCallback, delay, user_data);
+	pServices[serviceId].oneShot = true;
+
+	TimerSchedule(serviceId, TimerNow() + pServices[serviceId].period);
+	TimerArm();
+
+	TimerExitCritical(primask);
+	return serviceId;
 }
 
 bool TimerUnregisterPeriodicInterruption(service_id serviceId)
 {
-	if (serviceId >= registeredServicesCount)
+	if (serviceId >= registeredServicesCount || pServices[serviceId].pCallback == 0)
 	{
 		return false;
 	}
 
-	PeriodicService temp = pServices[registeredServicesCount--];
-	pServices[serviceId] = temp;
+	uint32_t primask = TimerEnterCritical();
+	TimerCancel(serviceId);
+	pServices[serviceId].pCallback = 0;
+	TimerArm();
+	TimerExitCritical(primask);
 	return true;
 }
 
 
 void TimerSetEnable(service_id serviceId, bool enable)
 {
-	PeriodicService* pService = &pServices[serviceId];
-	pService->enable = enable;
-	pService->tickCount = pService->tickInterval;
+	uint32_t primask = TimerEnterCritical();
+
+	// Enabling restarts the count, the next call comes a whole period later
+	TimerCancel(serviceId);
+	if (enable)
+	{
+		TimerSchedule(serviceId, TimerNow() + pServices[serviceId].period);
+	}
+	TimerArm();
+
+	TimerExitCritical(primask);
 }
 
 void TimerSetUserData(service_id serviceId, void* user_data)
@@ -116,9 +448,72 @@ void TimerSetUserData(service_id serviceId, void* user_data)
 	pService->user_data = user_data;
 }
 
+void TimerSetDeferred(service_id serviceId, bool deferred)
+{
+	pServices[serviceId].deferred = deferred;
+}
+
+bool TimerPostDeferred(callback* pCallback, void* user_data)
+{
+	uint32_t primask = TimerEnterCritical();
+
+	uint8_t next = (deferredHead + 1) % TIMER_DEFERRED_QUEUE_SIZE;
+	if (next == deferredTail)
+	{
+		stats.deferredDropped++;
+		TimerExitCritical(primask);
+		return false;
+	}
+
+	deferredQueue[deferredHead].pCallback = pCallback;
+	deferredQueue[deferredHead].user_data = user_data;
+	deferredHead = next;
+	stats.deferredPosted++;
+
+	TimerExitCritical(primask);
+	return true;
+}
+
+void TimerRunDeferred()
+{
+	// Only what is queued now, work that posts itself again waits for the next call instead of starving the loop
+	uint8_t end = deferredHead;
+	while (deferredTail != end)
+	{
+		DeferredWork work = deferredQueue[deferredTail];
+		deferredTail = (deferredTail + 1) % TIMER_DEFERRED_QUEUE_SIZE;
+		work.pCallback(work.user_data);
+	}
+}
+
+void TimerGetStats(TimerStats* pStats)
+{
+	uint32_t primask = TimerEnterCritical();
+	*pStats = stats;
+	pStats->enabledServices = heapSize;
+	TimerExitCritical(primask);
+}
+
+void TimerResetStats()
+{
+	uint32_t primask = TimerEnterCritical();
+	memset(&stats, 0, sizeof(TimerStats));
+	TimerExitCritical(primask);
+}
+
 ticks Now()
 {
-	return current_ticks;
+	return TimerNow();
+}
+
+uint64_t NowCycles()
+{
+	return TimerCoreCycles();
+}
+
+uint64_t NowMicros()
+{
+	return TimerCoreCycles() / CYCLES_PER_MICROSECOND;
 }
 
 void Sleep(ticks dt)
@@ -20,12 +20,28 @@
 typedef unsigned long long ticks;
 typedef uint32_t service_id;
 
+typedef struct
+{
+	uint32_t interrupts;		// Ticks served
+	uint32_t callbacks;			// Service calls made from the tick
+	uint32_t isrCycles;			// Core cycles spent in the tick interrupt, callbacks included
+	uint32_t isrMaxCycles;		// Longest single tick
+	uint32_t enabledServices;
+	uint32_t deferredPosted;	// Work items queued for TimerRunDeferred
+	uint32_t deferredDropped;	// Work items lost because the queue was full
+} TimerStats;
+
 /*******************************************************************************
  *                                MACROS
  ******************************************************************************/
+// Build with TIMER_TICKLESS defined to drop the periodic SysTick. PIT channels 0 to 2 then keep Now() and
+// interrupt only when a service is due, an idle system takes no timer interrupts at all
 #define TICKS_PER_SECOND (ticks)1000u
-#define MS_TO_TICKS(x) (ticks)((x) * TICKS_PER_SECOND/1000)
-#define US_TO_TICKS(x) (ticks)((x) * ( TICKS_PER_SECOND)/1000000)
+// Rounded up, so a short non zero delay still waits for at least one tick
+#define MS_TO_TICKS(x) (ticks)(((x) * TICKS_PER_SECOND + 999u) / 1000u)
+#define US_TO_TICKS(x) (ticks)(((x) * TICKS_PER_SECOND + 999999u) / 1000000u)
+
+#define TIMER_DEFERRED_QUEUE_SIZE 32	// Pending deferred work items, one slot stays empty
 
 /*******************************************************************************
  *                               PROTOTIPOS
@@ -35,7 +51,27 @@ service_id TimerRegisterPeriodicInterruption(callback* pCallback, ticks deltaT,
 void TimerSetUserData(service_id serviceId, void* user_data);
 void TimerSetEnable(service_id serviceId, bool enable);
 bool TimerUnregisterPeriodicInterruption(service_id serviceId);
+
+// Calls pCallback once, delay ticks from now. TimerSetEnable(serviceId, true) arms it again for another delay,
+// false cancels it. The slot stays registered until TimerUnregisterPeriodicInterruption
+service_id TimerRegisterOneShot(callback* pCallback, ticks delay, void* user_data);
+
+// Deferred services post their callback to the deferred work queue instead of calling it from the tick interrupt
+void TimerSetDeferred(service_id serviceId, bool deferred);
+
+// Queues pCallback to run from TimerRunDeferred, in posting order. Returns false if the queue is full. Safe from interrupts
+bool TimerPostDeferred(callback* pCallback, void* user_data);
+// Runs the work posted before the call. Call it from the main loop, never from an interrupt
+void TimerRunDeferred();
+
+void TimerGetStats(TimerStats* pStats);
+void TimerResetStats();
+// Safe from any context, the 64 bit count is never read torn
 ticks Now();
+// Core cycles and microseconds since TimerInit, the tick count plus the progress of the running timer.
+// Monotonic, also with interrupts masked as long as they are not masked for a whole tick
+uint64_t NowCycles();
+uint64_t NowMicros();
 void Sleep(ticks dt);
 
 #endif /* DRIVERS_TIMER_H_ */
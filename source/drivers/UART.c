@@ -6,163 +6,862 @@
  */
 
 #include "UART.h"
-#include <stdlib.h>
 #include <string.h>
 #include "hardware.h"
+#include "DMA.h"
+#include "RingBuffer.h"
+#include "Timer.h"
 
 #define MAX_UART_MODULES 6
+#define UART_FRAME_QUEUE_SIZE 8
+#define UART_TX_MARK_QUEUE_SIZE 16
 
 typedef struct {
-	UART_Config config;
-	uint8_t rxFifoSize;
-	uint8_t txFifoSize;
-
-	char* pReceiveBuffer;
-	uint8_t receiveBufferPointer;
-	uint8_t receiveBufferBarrier;
-	uint8_t availableBytes;
+	uint16_t end;			// Receive ring position just past the last byte
+	uint16_t size;
+	bool overflow;
+	uint32_t timestamp;		// CYCCNT when it was closed
+} UARTFrame;
 
-	char* pTransmitBuffer;
-	uint8_t transmitBufferPointer;
-	uint8_t transmitBufferBarrier;
+typedef struct {
+	uint16_t end;			// Transmit ring position just past the last byte
+	uint32_t start;			// CYCCNT when it was queued
+	callback* pCallback;
+	void* user_data;
+} UARTWrite;
 
-	bool transmitting;
+typedef struct {
+	UART_Config config;
 
-	bool receiverOverflow;
-	bool newData;
-	uint8_t newDataByteSize;
+	RingBuffer receiveRing;		// Filled by the RX interrupt or the eDMA, drained by the application
+	RingBuffer transmitRing;	// Filled by the application, drained by the TX interrupt or the eDMA
+	RingBuffer priorityRing;	// High priority lane, sent ahead of transmitRing between its frames
+
+	// Ends of the frames queued in transmitRing, oldest at txMarkTail. Only kept with a priority lane,
+	// a mark that does not fit is dropped and its frame goes out merged with the next one
+	uint16_t txMarks[UART_TX_MARK_QUEUE_SIZE];
+	volatile uint8_t txMarkHead;
+	volatile uint8_t txMarkTail;
+	uint16_t txFrameRemaining;	// Bytes left of the transmitRing frame being sent, the lanes only switch at 0
+
+	volatile bool transmitting;
+	DMA_Channel txDmaChannel;
+	RingBuffer* pTxDmaRing;		// Lane of the transfer in flight
+	uint16_t txDmaCount;
+
+	// Pending UART_WriteAsync requests, oldest at writeTail
+	UARTWrite writes[UART_ASYNC_WRITE_QUEUE_SIZE];
+	volatile uint8_t writeHead;
+	volatile uint8_t writeTail;
+
+	// Transmit ring positions of the multidrop address bytes, oldest at addressTail
+	uint16_t addressMarks[UART_ADDRESS_QUEUE_SIZE];
+	volatile uint8_t addressHead;
+	volatile uint8_t addressTail;
+
+	// Transmit coalescing. Writes to an idle transmitter wait up to coalesceCycles for more data
+	uint32_t coalesceCycles;
+	uint32_t holdingSince;		// CYCCNT of the first held write
+	volatile bool holding;
+
+	// Armed by UART_NotifyWritable
+	callback* pWritableCallback;
+	void* writableUserData;
+	uint16_t writableThreshold;
+
+	DMA_Channel rxDmaChannel;
+	uint16_t dmaFrameStart;		// Receive ring position where the frame closed by the next idle line began
+
+	volatile bool receiverOverflow;
+	volatile bool receiveError;		// Framing, noise or parity error since the last UART_GetData
+
+	// Flow control. While throttled the receive interrupts are off, the fifo fills and the hardware deasserts RTS
+	uint8_t rxInterrupts;		// C2 bits that keep the receiver draining
+	uint16_t rtsThreshold;
+	volatile bool rxThrottled;
+
+	UART_Stats stats;
+	UART_BaudSetting baudSetting;
+
+	// Completed frames, oldest at frameTail
+	UARTFrame frames[UART_FRAME_QUEUE_SIZE];
+	uint8_t frameHead;
+	uint8_t frameTail;
+	bool frameOverflow;
+
+	// Delimiter / length prefix matcher
+	uint16_t frameLength;		// Bytes of the frame in progress
+	uint16_t expectedLength;	// Length prefix of the frame in progress
+	bool inFrame;				// Length prefix already received
+	uint16_t maxFrameSize;
 } UART;
 
+static UART uartModules[MAX_UART_MODULES];
+static service_id coalesceServices[MAX_UART_MODULES];
+static bool coalesceServiceRegistered[MAX_UART_MODULES];
 static UART* modules[MAX_UART_MODULES];
-static UART_Type* configRegisters[MAX_UART_MODULES] = UART_BASE_PTRS;
-
-#define CORE_CLOCK 		100000000
-#define SYSTEM_CLOCK 	CORE_CLOCK
-#define BUS_CLOCK 		CORE_CLOCK / 2
+static UART_Type* const configRegisters[MAX_UART_MODULES] = UART_BASE_PTRS;
+static const IRQn_Type rxTxIRQs[MAX_UART_MODULES] = UART_RX_TX_IRQS;
+static const IRQn_Type errIRQs[MAX_UART_MODULES] = UART_ERR_IRQS;
+
+// UART4 and UART5 share a single DMAMUX slot for transmit and receive
+static const uint8_t txDmaSources[MAX_UART_MODULES] = {
+		(uint8_t)kDmaRequestMux0UART0Tx, (uint8_t)kDmaRequestMux0UART1Tx, (uint8_t)kDmaRequestMux0UART2Tx,
+		(uint8_t)kDmaRequestMux0UART3Tx, (uint8_t)kDmaRequestMux0UART4, (uint8_t)kDmaRequestMux0UART5
+};
+static const uint8_t rxDmaSources[MAX_UART_MODULES] = {
+		(uint8_t)kDmaRequestMux0UART0Rx, (uint8_t)kDmaRequestMux0UART1Rx, (uint8_t)kDmaRequestMux0UART2Rx,
+		(uint8_t)kDmaRequestMux0UART3Rx, (uint8_t)kDmaRequestMux0UART4, (uint8_t)kDmaRequestMux0UART5
+};
+
+#ifndef UART_GENERIC_ISR
+// UART0 and UART1 have 8 byte fifos, the rest a single data register (PFIFO reports the same sizes).
+// The only source of the depth, so the interrupt paths fold it into an immediate
+#define UART_FIFO_DEPTH(n) ((n) < 2 ? 8 : 1)
+
+// The interrupt paths are inlined into each handler with a constant module number, so the register base,
+// the module state address and the fifo depth fold into immediates instead of being looked up per byte
+#define UART_ISR_INLINE __STATIC_FORCEINLINE
+#else
+// Host benchmark build of the paths before the specialization: a single copy shared by every handler,
+// which looks the module up at runtime
+static const uint8_t fifoDepths[MAX_UART_MODULES] = { 8, 8, 1, 1, 1, 1 };
+#define UART_FIFO_DEPTH(n) (fifoDepths[n])
+#define UART_ISR_INLINE static __attribute__((noipa))
+#endif
+
+#define UART_MIN_SBR 1u
+#define UART_MAX_SBR 0x1FFFu
 
 #define DEFAULT_BUFFER_SIZE 64u
+
+// The receive eDMA channel loops over the whole ring in a single major loop
+#if RING_BUFFER_MAX_CAPACITY > DMA_MAX_COUNT
+#error "The receive ring must fit one eDMA major loop"
+#endif
+
+// Storage for the modules initialized without their own buffers
+static uint8_t defaultReceiveBuffers[MAX_UART_MODULES][DEFAULT_BUFFER_SIZE];
+static uint8_t defaultTransmitBuffers[MAX_UART_MODULES][DEFAULT_BUFFER_SIZE];
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) < (b) ? (b) : (a))
 
-static void UART_TransmitBuffer_Impl(uint8_t numUart)
+static inline uint32_t UART_EnterCritical()
 {
-	UART_Type* pUCR = configRegisters[numUart];
-	UART* pUART = modules[numUart];
-	const volatile uint8_t* s1 = &pUCR->S1;
-	uint8_t transmitBarrier = pUART->transmitBufferBarrier;
-	uint8_t transmitPointer = pUART->transmitBufferPointer;
-	uint8_t bufferSize = pUART->config.transmitBufferSize;
-	uint8_t available_bytes = 0;
-	if (transmitPointer == transmitBarrier)
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static inline void UART_ExitCritical(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+// Cycle accounting of the interrupt handlers, CYCCNT is enabled in UART_Init
+static inline void UART_AccountCycles_Impl(UART* pUART, uint32_t start)
+{
+	uint32_t cycles = DWT->CYCCNT - start;
+	pUART->stats.isrCycles += cycles;
+	if (cycles > pUART->stats.isrMaxCycles)
+		pUART->stats.isrMaxCycles = cycles;
+}
+
+static void UART_TransmitComplete_Impl(UART* pUART)
+{
+	if (pUART->config.pTxCompleteCallback)
+	{
+		pUART->config.pTxCompleteCallback(pUART->config.txCompleteUserData);
+	}
+}
+
+static void UART_NotifyWritable_Impl(UART* pUART)
+{
+	callback* pCallback = pUART->pWritableCallback;
+	if (pCallback == 0 || RingBuffer_Free(&pUART->transmitRing) < pUART->writableThreshold)
+		return;
+
+	pUART->pWritableCallback = 0;
+	pCallback(pUART->writableUserData);
+}
+
+static void UART_CompleteWrites_Impl(UART_Type* pUCR, UART* pUART, uint8_t s1)
+{
+	uint16_t tail = pUART->transmitRing.tail;
+	uint16_t sent = tail - pUCR->TCFIFO;
+
+	while (pUART->writeTail != pUART->writeHead)
+	{
+		UARTWrite* pWrite = &pUART->writes[pUART->writeTail];
+
+		// The last byte is out of the shift register once a later one left the fifo, or the transmitter went idle
+		bool done = (int16_t)(sent - pWrite->end) > 0 || ((s1 & UART_S1_TC_MASK) && (int16_t)(tail - pWrite->end) >= 0);
+		if (!done)
+			break;
+
+		uint32_t latency = DWT->CYCCNT - pWrite->start;
+		pUART->stats.asyncWrites++;
+		pUART->stats.writeLatencyLast = latency;
+		if (latency > pUART->stats.writeLatencyMax)
+			pUART->stats.writeLatencyMax = latency;
+
+		callback* pCallback = pWrite->pCallback;
+		void* user_data = pWrite->user_data;
+		pUART->writeTail = (pUART->writeTail + 1) % UART_ASYNC_WRITE_QUEUE_SIZE;
+		if (pCallback)
+		{
+			pCallback(user_data);
+		}
+	}
+
+	// Transmission complete is only needed to catch the end of the last pending write
+	if (pUART->writeTail == pUART->writeHead)
+		pUCR->C2 &= ~UART_C2_TCIE_MASK;
+}
+
+// Called by the writers with interrupts disabled. UART_WriteV reserves lock free before it gets here, so a writer
+// preempted in between can queue its mark after a later frame. The later mark then ends both frames and the earlier
+// one is skipped once it falls behind the tail: frames only merge, the priority lane waits for the longer one
+static inline void UART_PushTxMark_Impl(UART* pUART, uint16_t end)
+{
+	uint8_t next = (pUART->txMarkHead + 1) % UART_TX_MARK_QUEUE_SIZE;
+	if (pUART->priorityRing.pBuffer == 0 || next == pUART->txMarkTail)
+		return;
+
+	pUART->txMarks[pUART->txMarkHead] = end;
+	pUART->txMarkHead = next;
+}
+
+// Size of the next frame in transmitRing. Marks behind the tail belong to frames already sent merged with others
+static uint16_t UART_NextTxFrame_Impl(UART* pUART)
+{
+	RingBuffer* pRing = &pUART->transmitRing;
+	while (pUART->txMarkTail != pUART->txMarkHead)
+	{
+		int16_t size = (int16_t)(pUART->txMarks[pUART->txMarkTail] - pRing->tail);
+		pUART->txMarkTail = (pUART->txMarkTail + 1) % UART_TX_MARK_QUEUE_SIZE;
+		if (size > 0)
+			return (uint16_t)size;
+	}
+
+	// The head is only published once every reserved frame is complete, so it always ends one
+	return RingBuffer_Count(pRing);
+}
+
+// Next contiguous run to send and the lane it comes from. 0 once both lanes are empty
+static uint16_t UART_NextTxChunk_Impl(UART* pUART, RingBuffer** ppRing, const uint8_t** ppData)
+{
+	if (pUART->txFrameRemaining == 0)
+	{
+		// Between frames the priority lane goes first, and is drained whole
+		if (RingBuffer_Count(&pUART->priorityRing) != 0)
+		{
+			*ppRing = &pUART->priorityRing;
+			return RingBuffer_PeekContiguous(&pUART->priorityRing, ppData);
+		}
+
+		if (RingBuffer_Count(&pUART->transmitRing) == 0)
+			return 0;
+		pUART->txFrameRemaining = UART_NextTxFrame_Impl(pUART);
+	}
+
+	// The rest of the frame may still be in the hands of its writer
+	*ppRing = &pUART->transmitRing;
+	uint16_t count = RingBuffer_PeekContiguous(&pUART->transmitRing, ppData);
+	return MIN(count, pUART->txFrameRemaining);
+}
+
+// Next chunk, or stops the transmitter once both lanes are empty. A writer preempting the interrupt between the
+// empty check and the stop would see it still running and leave its data behind, so both happen with interrupts
+// disabled. UART_StartTransmission sets transmitting and TIE back under the same lock
+static uint16_t UART_NextTxChunkOrStop_Impl(UART_Type* pUCR, UART* pUART, RingBuffer** ppRing, const uint8_t** ppData)
+{
+	uint32_t primask = UART_EnterCritical();
+	uint16_t count = UART_NextTxChunk_Impl(pUART, ppRing, ppData);
+	if (count == 0)
 	{
 		// Disable Transmit Interrupts
 		pUCR->C2 = pUCR->C2 & ~UART_C2_TIE_MASK;
 		pUART->transmitting = 0;
+	}
+	UART_ExitCritical(primask);
+	return count;
+}
+
+static inline void UART_ConsumeTxChunk_Impl(UART* pUART, RingBuffer* pRing, uint16_t count)
+{
+	RingBuffer_Consume(pRing, count);
+	if (pRing == &pUART->transmitRing)
+		pUART->txFrameRemaining -= count;
+	pUART->stats.bytesTransmitted += count;
+}
+
+UART_ISR_INLINE void UART_TransmitBuffer_Impl(uint8_t numUart)
+{
+	UART_Type* pUCR = configRegisters[numUart];
+	UART* pUART = &uartModules[numUart];
+
+	RingBuffer* pRing;
+	const uint8_t* pData;
+	uint16_t count = UART_NextTxChunkOrStop_Impl(pUCR, pUART, &pRing, &pData);
+	if (count == 0)
+	{
+		UART_TransmitComplete_Impl(pUART);
+		return;
+	}
+
+	// This is the maximum number it can send in this specific interruption, the free space in the fifo.
+	// The fifo has room for every byte, so there is no need to wait on TDRE between writes
+	uint8_t allowed_to_send = UART_FIFO_DEPTH(numUart) - pUCR->TCFIFO;
+
+	// One contiguous part at a time, split where the data wraps around the end of a ring or changes lane
+	while (count != 0 && allowed_to_send > 0)
+	{
+		count = MIN(count, allowed_to_send);
+		uint16_t position = pRing->tail;
+		bool normalLane = pRing == &pUART->transmitRing;
+		for (uint16_t i = 0; i < count; i++)
+		{
+			// Address bytes go out with the ninth bit set, T8 is latched with the write to D
+			if (normalLane && pUART->addressHead != pUART->addressTail && (uint16_t)(position + i) == pUART->addressMarks[pUART->addressTail])
+			{
+				pUCR->C3 |= UART_C3_T8_MASK;
+				pUCR->D = pData[i];
+				pUCR->C3 &= ~UART_C3_T8_MASK;
+				pUART->addressTail = (pUART->addressTail + 1) % UART_ADDRESS_QUEUE_SIZE;
+			}
+			else
+			{
+				pUCR->D = pData[i];
+			}
+		}
+		UART_ConsumeTxChunk_Impl(pUART, pRing, count);
+		allowed_to_send -= count;
+		if (allowed_to_send > 0)
+			count = UART_NextTxChunk_Impl(pUART, &pRing, &pData);
+	}
+
+	UART_NotifyWritable_Impl(pUART);
+}
+
+static void UART_TransmitDMA_Impl(uint8_t numUart)
+{
+	UART_Type* pUCR = configRegisters[numUart];
+	UART* pUART = modules[numUart];
+
+	// A transfer is already in flight, the completion interrupt will chain the next one
+	if (pUART->txDmaCount != 0)
 		return;
+
+	// Only the contiguous part up to the end of the ring or frame, the rest goes on the next transfer
+	const uint8_t* pData;
+	RingBuffer* pRing;
+	uint16_t count = UART_NextTxChunkOrStop_Impl(pUCR, pUART, &pRing, &pData);
+	if (count == 0)
+	{
+		UART_TransmitComplete_Impl(pUART);
+		return;
+	}
+
+	pUART->pTxDmaRing = pRing;
+	pUART->txDmaCount = count;
+
+	DMA_Transfer transfer = {
+			.pSource = pData,
+			.pDestination = &pUCR->D,
+			.sourceOffset = 1,
+			.destinationOffset = 0,
+			.count = count,
+			.sourceLastAdjust = 0,
+			.destinationLastAdjust = 0,
+			.disableRequestOnDone = true,
+			.interruptOnDone = true,
+			.interruptOnHalf = false
+	};
+	DMA_SetupTransfer(pUART->txDmaChannel, &transfer);
+	DMA_EnableRequest(pUART->txDmaChannel);
+
+	// With TDMAS set TIE raises DMA requests instead of interrupts
+	pUCR->C2 |= UART_C2_TIE(1);
+}
+
+static void UART_TransmitDMADone(void* user_data)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint8_t numUart = (uint8_t)(uintptr_t)user_data;
+	UART* pUART = modules[numUart];
+
+	UART_ConsumeTxChunk_Impl(pUART, pUART->pTxDmaRing, pUART->txDmaCount);
+	pUART->stats.dmaInterrupts++;
+
+	// Writers start transfers too, one of them seeing txDmaCount cleared before the next transfer is set up would
+	// send the same chunk twice
+	uint32_t primask = UART_EnterCritical();
+	pUART->txDmaCount = 0;
+	UART_TransmitDMA_Impl(numUart);
+	UART_ExitCritical(primask);
+	UART_NotifyWritable_Impl(pUART);
+	if (pUART->writeTail != pUART->writeHead)
+		UART_CompleteWrites_Impl(configRegisters[numUart], pUART, configRegisters[numUart]->S1);
+	UART_AccountCycles_Impl(pUART, start);
+}
+
+// The eDMA stopped the transmit channel part way. The bytes it moved are on their way, the rest goes on a new transfer
+static void UART_TransmitDMAError(void* user_data)
+{
+	uint8_t numUart = (uint8_t)(uintptr_t)user_data;
+	UART* pUART = modules[numUart];
+	pUART->stats.dmaErrors++;
+
+	uint32_t primask = UART_EnterCritical();
+	if (pUART->txDmaCount != 0)
+	{
+		uint16_t sent = pUART->txDmaCount - DMA_GetRemainingCount(pUART->txDmaChannel);
+		UART_ConsumeTxChunk_Impl(pUART, pUART->pTxDmaRing, sent);
+		pUART->txDmaCount = 0;
+	}
+	UART_TransmitDMA_Impl(numUart);
+	UART_ExitCritical(primask);
+}
+
+// The receive channel keeps its place in the ring, it only has to serve the requests again
+static void UART_ReceiveDMAError(void* user_data)
+{
+	uint8_t numUart = (uint8_t)(uintptr_t)user_data;
+	UART* pUART = modules[numUart];
+	pUART->stats.dmaErrors++;
+	DMA_EnableRequest(pUART->rxDmaChannel);
+}
+
+static void UART_StartTransmission(uint8_t numUart)
+{
+	UART* pUART = modules[numUart];
+
+	// C2 is also modified by the interrupt, keep it out while updating it
+	uint32_t primask = UART_EnterCritical();
+	pUART->transmitting = 1;
+
+	if (pUART->config.useDmaTx)
+	{
+		UART_TransmitDMA_Impl(numUart);
 	}
 	else
 	{
-		// Barrier in fron of pointer
-		if (transmitBarrier > transmitPointer)
+		// The TX interrupt is the only consumer of the ring. TDRE is set while the fifo has room, so it fires right away
+		configRegisters[numUart]->C2 |= UART_C2_TIE(1);
+	}
+
+	// Catches the end of the pending async writes if nothing else follows them. Only once the data is
+	// on its way, TC stays set while the transmitter idles
+	if (pUART->writeHead != pUART->writeTail)
+		configRegisters[numUart]->C2 |= UART_C2_TCIE(1);
+	UART_ExitCritical(primask);
+}
+
+// Ends the coalescing window early. Called with interrupts disabled
+static inline void UART_ReleaseHold_Impl(UART* pUART, uint8_t numUart)
+{
+	pUART->holding = false;
+	if (pUART->coalesceCycles != 0)
+		TimerSetEnable(coalesceServices[numUart], false);
+}
+
+static void UART_KickTransmission(uint8_t numUart)
+{
+	UART* pUART = modules[numUart];
+
+	// Data written while the transmitter runs is picked up by it anyway
+	if (pUART->coalesceCycles == 0 || pUART->transmitting)
+	{
+		UART_StartTransmission(numUart);
+		return;
+	}
+
+	uint32_t primask = UART_EnterCritical();
+	uint32_t now = DWT->CYCCNT;
+	if (!pUART->holding)
+	{
+		// The timer only wakes up once, at the end of this window
+		pUART->holding = true;
+		pUART->holdingSince = now;
+		TimerSetEnable(coalesceServices[numUart], true);
+	}
+
+	bool flush = now - pUART->holdingSince >= pUART->coalesceCycles ||
+			(pUART->config.coalesceBytes != 0 && RingBuffer_Count(&pUART->transmitRing) >= pUART->config.coalesceBytes);
+	if (flush)
+		UART_ReleaseHold_Impl(pUART, numUart);
+	UART_ExitCritical(primask);
+
+	if (flush)
+		UART_StartTransmission(numUart);
+}
+
+// One shot timer service armed when holding starts, sends the held data once the window is over
+static void UART_CoalesceService(void* user_data)
+{
+	uint8_t numUart = (uint8_t)(uintptr_t)user_data;
+	UART* pUART = modules[numUart];
+	if (pUART == 0)
+		return;
+
+	uint32_t primask = UART_EnterCritical();
+	bool flush = pUART->holding;
+	pUART->holding = false;
+	UART_ExitCritical(primask);
+
+	if (flush)
+		UART_StartTransmission(numUart);
+}
+
+UART_ISR_INLINE void UART_ThrottleReceiver_Impl(UART_Type* pUCR, UART* pUART)
+{
+	if (!pUART->config.flowControl || pUART->rxThrottled)
+		return;
+
+	// Stop draining the fifo. Once it reaches the watermark RTS goes high and the peer stops sending
+	if (RingBuffer_Count(&pUART->receiveRing) >= pUART->rtsThreshold)
+	{
+		pUCR->C2 &= ~pUART->rxInterrupts;
+		pUART->rxThrottled = true;
+	}
+}
+
+static void UART_ResumeReceiver(UART_Handle handle)
+{
+	UART* pUART = modules[handle];
+	if (!pUART->rxThrottled)
+		return;
+
+	// Half the threshold of hysteresis so RTS does not toggle on every byte
+	if (RingBuffer_Count(&pUART->receiveRing) > pUART->rtsThreshold / 2)
+		return;
+
+	uint32_t primask = UART_EnterCritical();
+	pUART->rxThrottled = false;
+	configRegisters[handle]->C2 |= pUART->rxInterrupts;
+	UART_ExitCritical(primask);
+}
+
+// Framing, noise and parity flags of the byte at the head of the fifo. Reading D after S1 clears them
+UART_ISR_INLINE void UART_CountErrors_Impl(UART* pUART, uint8_t s1)
+{
+	if (!(s1 & (UART_S1_FE_MASK | UART_S1_NF_MASK | UART_S1_PF_MASK)))
+		return;
+
+	pUART->receiveError = true;
+	if (s1 & UART_S1_FE_MASK)
+		pUART->stats.framingErrors++;
+	if (s1 & UART_S1_NF_MASK)
+		pUART->stats.noiseErrors++;
+	if (s1 & UART_S1_PF_MASK)
+		pUART->stats.parityErrors++;
+}
+
+static void UART_PushFrame_Impl(UART* pUART, uint16_t end, uint16_t size)
+{
+	uint8_t next = (pUART->frameHead + 1) % UART_FRAME_QUEUE_SIZE;
+	if (next == pUART->frameTail)
+	{
+		// Queue full, the frame is dropped and reported on the next delivered one
+		pUART->frameOverflow = true;
+		return;
+	}
+
+	UARTFrame* pFrame = &pUART->frames[pUART->frameHead];
+	pFrame->end = end;
+	pFrame->size = size;
+	pFrame->timestamp = DWT->CYCCNT;
+	pFrame->overflow = pUART->frameOverflow;
+	pUART->frameOverflow = false;
+	pUART->frameHead = next;
+	pUART->stats.frames++;
+
+	if (pUART->config.pFrameCallback)
+	{
+		pUART->config.pFrameCallback(pUART->config.frameUserData);
+	}
+}
+
+// Runs on every received byte, end is the ring position just past it
+UART_ISR_INLINE void UART_MatchFrame_Impl(UART* pUART, uint8_t data, uint16_t end)
+{
+	switch (pUART->config.frameMode)
+	{
+	case UART_FRAME_DELIMITER:
+		if (data == pUART->config.frameDelimiter)
 		{
-			available_bytes = transmitPointer + (bufferSize - transmitBarrier);
+			// Back to back delimiters do not make empty frames
+			if (pUART->frameLength != 0)
+				UART_PushFrame_Impl(pUART, end - 1, pUART->frameLength);
+			pUART->frameLength = 0;
 		}
-		// Barrier behind pointer
-		else
+		else if (++pUART->frameLength >= pUART->maxFrameSize)
+		{
+			// No delimiter in sight, hand over what there is and flag it
+			pUART->frameOverflow = true;
+			UART_PushFrame_Impl(pUART, end, pUART->frameLength);
+			pUART->frameLength = 0;
+		}
+		break;
+
+	case UART_FRAME_LENGTH_PREFIX:
+		if (!pUART->inFrame)
 		{
-			available_bytes = transmitPointer - transmitBarrier;
+			pUART->expectedLength = data;
+			pUART->frameLength = 0;
+			pUART->inFrame = data != 0;
+			if (data == 0)
+				UART_PushFrame_Impl(pUART, end, 0);
 		}
+		else if (++pUART->frameLength == pUART->expectedLength)
+		{
+			UART_PushFrame_Impl(pUART, end, pUART->frameLength);
+			pUART->inFrame = false;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+static inline void UART_UpdateHighWater_Impl(const RingBuffer* pRing, uint16_t* pHighWater)
+{
+	uint16_t count = RingBuffer_Count(pRing);
+	if (count > *pHighWater)
+		*pHighWater = count;
+}
+
+UART_ISR_INLINE void UART_ReceiveByte_Impl(UART* pUART, uint8_t data)
+{
+	if (!RingBuffer_Push(&pUART->receiveRing, data))
+	{
+		pUART->receiverOverflow = true;
+		pUART->frameOverflow = true;
+		pUART->stats.droppedBytes++;
+	}
+	// Dropped bytes still go through the matcher to stay aligned with the sender
+	UART_MatchFrame_Impl(pUART, data, pUART->receiveRing.head);
+	pUART->stats.bytesReceived++;
+}
+
+UART_ISR_INLINE void UART_ReceiveFifo_Impl(uint8_t numUart)
+{
+	UART_Type* pUCR = configRegisters[numUart];
+	UART* pUART = &uartModules[numUart];
+	// Only called with data available, a single register module holds exactly one byte
+	uint8_t bytesInFifo = UART_FIFO_DEPTH(numUart) == 1 ? 1 : pUCR->RCFIFO;
+	for (uint8_t i = 0; i < bytesInFifo; i++)
+	{
+		UART_ReceiveByte_Impl(pUART, pUCR->D);
+	}
+	UART_UpdateHighWater_Impl(&pUART->receiveRing, &pUART->stats.rxHighWater);
+}
 
-		// This is the number of bytes that the transmitter has yet to send
-		uint8_t remaining_to_send = bufferSize - available_bytes;
+UART_ISR_INLINE void UARTX_ERR_IRQImpl(uint8_t numUart)
+{
+	uint32_t start = DWT->CYCCNT;
+	UART_Type* pUCR = configRegisters[numUart];
+	UART* pUART = &uartModules[numUart];
+	volatile uint8_t s1 = pUCR->S1;
+	pUART->stats.errorInterrupts++;
 
-		// This is the maximum number it can send in this specific interruption. This is the remaining bytes to send clamped to the fifo size
-		uint8_t allowed_to_send = MIN(remaining_to_send, pUART->txFifoSize - pUCR->TCFIFO);
+	// Flags still set were not cleared by the receive interrupt draining the fifo
+	UART_CountErrors_Impl(pUART, s1);
 
-		// Wait for the data shift register to be empty
-		//while(!(*s1 & UART_S1_TDRE_MASK)) {}
+	if (s1 & UART_S1_OR_MASK)
+	{
+		pUART->receiverOverflow = true;
+		pUART->stats.overruns++;
+	}
 
-		// Send each byte to the fifo one by one, waiting for the register to be ready each time
-		for (int i = 0; i < allowed_to_send; i++)
+	// Reading D after S1 clears the flags. In DMA mode the eDMA's next read does it, reading here would steal its byte
+	if (!pUART->config.useDmaRx && (s1 & (UART_S1_OR_MASK | UART_S1_FE_MASK | UART_S1_NF_MASK | UART_S1_PF_MASK)))
+	{
+		if (UART_FIFO_DEPTH(numUart) == 1 || pUCR->RCFIFO != 0)
 		{
-			pUCR->D = pUART->pTransmitBuffer[(transmitPointer + i) % bufferSize];
-			while(!(*s1 & UART_S1_TDRE_MASK)) {}
+			UART_ReceiveByte_Impl(pUART, pUCR->D);
+			UART_UpdateHighWater_Impl(&pUART->receiveRing, &pUART->stats.rxHighWater);
 		}
+		else
+		{
+			// The receive interrupt already drained the fifo, reading the empty fifo underflows it
+			(void)(uint8_t)pUCR->D;
+			pUCR->CFIFO |= UART_CFIFO_RXFLUSH(1);
+			pUCR->SFIFO = UART_SFIFO_RXUF_MASK;
+		}
+	}
 
-		// Adjust the new value for the transmit pointer and available bytes variables
-		pUART->transmitBufferPointer = (transmitPointer + allowed_to_send) % bufferSize;
-		pUART->availableBytes = available_bytes + allowed_to_send;
+	UART_AccountCycles_Impl(pUART, start);
+}
+
+// Publishes the bytes the eDMA wrote into the ring storage since the last call. Runs from the idle interrupt and,
+// with flow control, from the half and major loop interrupts of the channel
+static void UART_PublishDMA_Impl(UART_Type* pUCR, UART* pUART)
+{
+	RingBuffer* pRing = &pUART->receiveRing;
+	uint32_t primask = UART_EnterCritical();
+	uint16_t writeIndex = (RingBuffer_Capacity(pRing) - DMA_GetRemainingCount(pUART->rxDmaChannel)) & pRing->mask;
+	uint16_t size = (writeIndex - pRing->head) & pRing->mask;
+	if (size == 0)
+	{
+		UART_ExitCritical(primask);
+		return;
+	}
+
+	// If the application fell behind the eDMA overwrote the oldest bytes
+	uint16_t freeBytes = RingBuffer_Free(pRing);
+	if (size > freeBytes)
+	{
+		pUART->receiverOverflow = true;
+		pUART->stats.droppedBytes += size - freeBytes;
+	}
 
-		if (pUART->transmitBufferPointer != transmitBarrier)
+	uint16_t start = pRing->head;
+	RingBuffer_Commit(pRing, size);
+	pUART->stats.bytesReceived += size;
+	UART_UpdateHighWater_Impl(pRing, &pUART->stats.rxHighWater);
+
+	if (pUART->config.frameMode != UART_FRAME_IDLE)
+	{
+		for (uint16_t i = 0; i < size; i++)
 		{
-			pUCR->C2 |= UART_C2_TIE(1);
+			uint16_t position = start + i;
+			UART_MatchFrame_Impl(pUART, pRing->pBuffer[position & pRing->mask], position + 1);
 		}
 	}
+	UART_ThrottleReceiver_Impl(pUCR, pUART);
+	UART_ExitCritical(primask);
 }
 
-static void UARTX_ERR_IRQImpl(uint8_t numUart)
+// Half and major loop interrupts of the receive channel, enabled with flow control
+static void UART_ReceiveDMAProgress(void* user_data)
 {
-	UART_Type* pUCR = configRegisters[numUart];
+	uint32_t start = DWT->CYCCNT;
+	uint8_t numUart = (uint8_t)(uintptr_t)user_data;
 	UART* pUART = modules[numUart];
-	volatile uint8_t s1 = pUCR->S1;
+	pUART->stats.dmaInterrupts++;
+	UART_PublishDMA_Impl(configRegisters[numUart], pUART);
+	UART_AccountCycles_Impl(pUART, start);
+}
 
-	if (s1 & UART_S1_OR_MASK)
+UART_ISR_INLINE void UART_ReceiveIdle_Impl(uint8_t numUart)
+{
+	UART_Type* pUCR = configRegisters[numUart];
+	UART* pUART = &uartModules[numUart];
+
+	// IDLE is cleared by reading D after S1
+	if (!pUART->config.useDmaRx && pUCR->RCFIFO != 0)
+	{
+		// Bytes left under the watermark when the burst ended
+		UART_ReceiveFifo_Impl(numUart);
+		UART_ThrottleReceiver_Impl(pUCR, pUART);
+		return;
+	}
+
+	// Wait until the eDMA has drained the fifo so no byte is stolen
+	if (pUCR->RCFIFO != 0)
+		return;
+
+	(void)(uint8_t)pUCR->D;
+	// Reading the empty fifo underflows it
+	pUCR->CFIFO |= UART_CFIFO_RXFLUSH(1);
+	pUCR->SFIFO = UART_SFIFO_RXUF_MASK;
+
+	if (!pUART->config.useDmaRx)
+		return;
+
+	UART_PublishDMA_Impl(pUCR, pUART);
+
+	// Part of the frame may have been published by the eDMA interrupts, it runs from the end of the previous one
+	RingBuffer* pRing = &pUART->receiveRing;
+	uint16_t size = pRing->head - pUART->dmaFrameStart;
+	if (pUART->config.frameMode == UART_FRAME_IDLE && size != 0)
 	{
-		pUART->pReceiveBuffer[pUART->receiveBufferPointer++] = pUCR->D;
+		UART_PushFrame_Impl(pUART, pRing->head, size);
 	}
+	pUART->dmaFrameStart = pRing->head;
 }
 
-static void UARTX_RX_TX_IRQImpl(uint8_t numUart)
+UART_ISR_INLINE void UARTX_RX_TX_IRQImpl(uint8_t numUart)
 {
+	uint32_t start = DWT->CYCCNT;
 	UART_Type* pUCR = configRegisters[numUart];
-	UART* pUART = modules[numUart];
+	UART* pUART = &uartModules[numUart];
 	volatile uint8_t s1 = pUCR->S1;
+	pUART->stats.rxTxInterrupts++;
 
 	// Test for each type of interrupt
-	// Transmitter complete interrupt
-	if (pUART->transmitting && (s1 & UART_S1_TDRE_MASK))
+	// Transmitter complete interrupt. In DMA mode TDRE is served by the eDMA
+	if (!pUART->config.useDmaTx && pUART->transmitting && (s1 & UART_S1_TDRE_MASK))
 	{
 		UART_TransmitBuffer_Impl(numUart);
 	}
-	// Received data interrupt
-	if (s1 & UART_S1_RDRF_MASK)
+	// Async writes whose bytes went out, either with the fifo refill or on transmission complete
+	if (pUART->writeTail != pUART->writeHead)
 	{
-		// TODO: FIX
-		uint8_t bytesInFifo = pUCR->RCFIFO;
-		for (uint8_t i = 0; i < bytesInFifo; i++)
-		{
-			uint16_t index = (pUART->receiveBufferPointer + i) % pUART->config.receiveBufferSize;
-			pUART->pReceiveBuffer[index] = pUCR->D;
-		}
-		pUART->receiveBufferPointer = (pUART->receiveBufferPointer + bytesInFifo)% pUART->config.receiveBufferSize;
-		pUART->newData = 1;
-		if (pUART->newDataByteSize > pUART->config.receiveBufferSize)
-			pUART->receiverOverflow = true;
-		pUART->newDataByteSize = MIN(pUART->newDataByteSize + bytesInFifo, pUART->config.receiveBufferSize);
+		UART_CompleteWrites_Impl(pUCR, pUART, s1);
+	}
+	// Idle line after a burst. Enabled in DMA receive mode or with rxIdleTimeout
+	if ((s1 & UART_S1_IDLE_MASK) && (pUCR->C2 & UART_C2_ILIE_MASK))
+	{
+		// Drains the whole fifo. RDRF in s1 is stale after it, a byte arriving meanwhile raises a new interrupt
+		UART_ReceiveIdle_Impl(numUart);
+	}
+	// Received data interrupt. In DMA mode RDRF is served by the eDMA. Left in the fifo while throttled
+	else if (!pUART->config.useDmaRx && (s1 & UART_S1_RDRF_MASK) && (pUCR->C2 & UART_C2_RIE_MASK))
+	{
+		UART_CountErrors_Impl(pUART, s1);
+		UART_ReceiveFifo_Impl(numUart);
+		UART_ThrottleReceiver_Impl(pUCR, pUART);
 	}
+
+	UART_AccountCycles_Impl(pUART, start);
+}
+
+static uint32_t UART_GetModuleClock(uint8_t uartNum)
+{
+	// UART0 and UART1 run from the core/system clock, the rest from the bus clock
+	if (uartNum < 2)
+		return __CORE_CLOCK__;
+
+	uint32_t outdiv1 = (SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT;
+	uint32_t outdiv2 = (SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV2_MASK) >> SIM_CLKDIV1_OUTDIV2_SHIFT;
+	return (uint32_t)(((uint64_t)__CORE_CLOCK__ * (outdiv1 + 1)) / (outdiv2 + 1));
+}
+
+bool UART_CalculateBaudRate(uint32_t moduleClock, uint32_t baudRate, uint16_t tolerance, UART_BaudSetting* pSetting)
+{
+	if (baudRate == 0)
+		return false;
+
+	// baud = clock / (16 * (SBR + BRFA/32)), so the divider in 1/32 steps is 32*SBR + BRFA = 2 * clock / baud
+	uint32_t divider = (uint32_t)((2 * (uint64_t)moduleClock + baudRate / 2) / baudRate);
+	uint32_t sbr = divider >> 5;
+	if (sbr < UART_MIN_SBR || sbr > UART_MAX_SBR)
+		return false;
+
+	uint32_t achieved = (uint32_t)((2 * (uint64_t)moduleClock + divider / 2) / divider);
+	uint32_t difference = achieved > baudRate ? achieved - baudRate : baudRate - achieved;
+	uint32_t error = (uint32_t)(((uint64_t)difference * 10000 + baudRate / 2) / baudRate);
+
+	pSetting->sbr = (uint16_t)sbr;
+	pSetting->brfa = (uint8_t)(divider & 0x1F);
+	pSetting->achievedBaudRate = achieved;
+	pSetting->error = (uint16_t)MIN(error, UINT16_MAX);
+
+	return error <= tolerance;
 }
 
-static uint8_t MapFIFOSizeToBytes(const uint8_t XXFIFOSIZE)
+static uint16_t RoundDownToPowerOfTwo(uint16_t size)
 {
-	switch (XXFIFOSIZE)
+	uint16_t capacity = 1;
+	while (capacity <= size / 2 && capacity < RING_BUFFER_MAX_CAPACITY)
 	{
-	case 0b000:
-		return 1;
-	case 0b001:
-		return 4;
-	case 0b010:
-		return 8;
-	case 0b011:
-		return 16;
-	case 0b100:
-		return 32;
-	case 0b101:
-		return 64;
-	case 0b110:
-		return 128;
-	default:
-		return 0;
+		capacity <<= 1;
 	}
+	return capacity;
 }
 
 UART_Handle UART_Init(UART_Config* pConfig)
@@ -173,6 +872,59 @@ UART_Handle UART_Init(UART_Config* pConfig)
 		return -1;
 	}
 
+	// Reject rates the module clock cannot generate within tolerance
+	UART_BaudSetting baudSetting;
+	uint16_t baudTolerance = pConfig->baudTolerance ? pConfig->baudTolerance : UART_DEFAULT_BAUD_TOLERANCE;
+	if (!UART_CalculateBaudRate(UART_GetModuleClock(pConfig->uartNum), pConfig->baudRate, baudTolerance, &baudSetting))
+	{
+		return -1;
+	}
+
+	// The ninth bit is the address mark, it can not carry parity. The eDMA can not set it per byte
+	if (pConfig->multidrop && (pConfig->parityEnable || pConfig->useDmaTx))
+	{
+		return -1;
+	}
+
+	// Without parity the ninth bit would be data, which neither the byte rings nor the eDMA carry.
+	// Multidrop sets the word length itself
+	if (pConfig->extendedDataBits && !pConfig->parityEnable && !pConfig->multidrop)
+	{
+		return -1;
+	}
+
+	// Reserve the DMA channel before touching the module
+	DMA_Channel txDmaChannel = -1;
+	if (pConfig->useDmaTx)
+	{
+		txDmaChannel = DMA_RequestChannel(txDmaSources[pConfig->uartNum], &UART_TransmitDMADone, (void*)(uintptr_t)pConfig->uartNum);
+		if (txDmaChannel < 0)
+		{
+			return -1;
+		}
+		DMA_SetErrorCallback(txDmaChannel, &UART_TransmitDMAError, (void*)(uintptr_t)pConfig->uartNum);
+	}
+
+	DMA_Channel rxDmaChannel = -1;
+	if (pConfig->useDmaRx)
+	{
+		// UART4 and UART5 can only serve one direction through the eDMA
+		if (pConfig->useDmaTx && rxDmaSources[pConfig->uartNum] == txDmaSources[pConfig->uartNum])
+		{
+			DMA_ReleaseChannel(txDmaChannel);
+			return -1;
+		}
+
+		rxDmaChannel = DMA_RequestChannel(rxDmaSources[pConfig->uartNum], &UART_ReceiveDMAProgress, (void*)(uintptr_t)pConfig->uartNum);
+		if (rxDmaChannel < 0)
+		{
+			if (txDmaChannel >= 0)
+				DMA_ReleaseChannel(txDmaChannel);
+			return -1;
+		}
+		DMA_SetErrorCallback(rxDmaChannel, &UART_ReceiveDMAError, (void*)(uintptr_t)pConfig->uartNum);
+	}
+
 	// Pin Configuration
 	if (!pConfig->skipPinSetup)
 	{
@@ -188,14 +940,29 @@ UART_Handle UART_Init(UART_Config* pConfig)
 			if (pConfig->tx == PORTNUM2PIN(PA, 2))
 				gpioMux(pConfig->tx, 2);
 		}
+
+		if (pConfig->flowControl)
+		{
+			gpioMux(pConfig->cts, 3);
+			gpioMux(pConfig->rts, 3);
+
+			if (pConfig->uartNum == 0)
+			{
+				if (pConfig->cts == PORTNUM2PIN(PA, 0))
+					gpioMux(pConfig->cts, 2);
+				if (pConfig->rts == PORTNUM2PIN(PA, 3))
+					gpioMux(pConfig->rts, 2);
+			}
+		}
 	}
 
 	// Register UART in driver
-	modules[pConfig->uartNum] = (UART*)calloc(1, sizeof(UART));
-	UART* pUART = modules[pConfig->uartNum];
+	UART* pUART = &uartModules[pConfig->uartNum];
+	memset(pUART, 0, sizeof(UART));
+	modules[pConfig->uartNum] = pUART;
 	pUART->config = *pConfig;
-
-	uint64_t uart_module_clock = BUS_CLOCK;
+	pUART->txDmaChannel = txDmaChannel;
+	pUART->rxDmaChannel = rxDmaChannel;
 
 	// Enable Clock Gating and interrupts
 
@@ -205,7 +972,6 @@ UART_Handle UART_Init(UART_Config* pConfig)
 			SIM->SCGC4 |= SIM_SCGC4_UART0(1);
 			//SIM->SOPT5 &= ~(SIM_SOPT5_UART0TXSRC_MASK | SIM_SOPT5_UART0RXSRC_MASK);
 			//SIM->SOPT5 |= (SIM_SOPT5_UART0TXSRC(1) | SIM_SOPT5_UART0RXSRC(1));
-			uart_module_clock = SYSTEM_CLOCK;
 			NVIC_EnableIRQ(UART0_RX_TX_IRQn);
 			NVIC_EnableIRQ(UART0_ERR_IRQn);
 			break;
@@ -213,7 +979,6 @@ UART_Handle UART_Init(UART_Config* pConfig)
 			SIM->SCGC4 |= SIM_SCGC4_UART1(1);
 			//SIM->SOPT5 &= ~(SIM_SOPT5_UART1TXSRC_MASK | SIM_SOPT5_UART1RXSRC_MASK);
 			//SIM->SOPT5 |= (SIM_SOPT5_UART1TXSRC(1) | SIM_SOPT5_UART1RXSRC(1));
-			uart_module_clock = SYSTEM_CLOCK;
 			NVIC_EnableIRQ(UART1_RX_TX_IRQn);
 			NVIC_EnableIRQ(UART1_ERR_IRQn);
 			break;
@@ -246,33 +1011,133 @@ UART_Handle UART_Init(UART_Config* pConfig)
 	pUCR->C2 &= ~(UART_C2_TE_MASK | UART_C2_RE_MASK);
 
 	// Baud rate configuration
-	uint16_t sbr = (uint16_t)(((double)uart_module_clock / (double)(16*pConfig->baudRate)) - (double)pConfig->brfd/(double)32);
-
+	// BDL must be written last, it latches the whole divider
+	uint16_t sbr = baudSetting.sbr;
 	pUCR->BDH = (uint8_t)((0b0001111100000000 & sbr) >> 8);
 	pUCR->BDL = (uint8_t)(0b0000000011111111 & sbr);
-	pUCR->C1 = UART_C1_PT(pConfig->parityType) | UART_C1_PE(pConfig->parityEnable);
+	pUCR->C4 = (pUCR->C4 & ~UART_C4_BRFA_MASK) | UART_C4_BRFA(baudSetting.brfa);
+	pUART->baudSetting = baudSetting;
+	pUCR->C1 = UART_C1_PT(pConfig->parityType) | UART_C1_PE(pConfig->parityEnable) |
+			UART_C1_M(pConfig->extendedDataBits || pConfig->multidrop) | UART_C1_LOOPS(pConfig->loopback);
+
+	// Address match. Address bytes for other stations and the data that follows them are discarded by the receiver
+	if (pConfig->multidrop)
+	{
+		pUCR->MA1 = UART_MA1_MA(pConfig->address);
+		pUCR->MA2 = UART_MA2_MA(UART_BROADCAST_ADDRESS);
+		pUCR->C4 = (pUCR->C4 & ~(UART_C4_MAEN1_MASK | UART_C4_MAEN2_MASK)) | UART_C4_MAEN1(1) | UART_C4_MAEN2(pConfig->acceptBroadcast);
+	}
 
 	// FIFO Configuration
 	pUCR->PFIFO |= UART_PFIFO_TXFE(1) | UART_PFIFO_RXFE(1);
 	pUCR->CFIFO |= UART_CFIFO_TXFLUSH(1) | UART_CFIFO_RXFLUSH(1);
-	pUART->rxFifoSize = MapFIFOSizeToBytes((pUCR->PFIFO & UART_PFIFO_RXFIFOSIZE_MASK) >> UART_PFIFO_RXFIFOSIZE_SHIFT);
-	pUART->txFifoSize = MapFIFOSizeToBytes((pUCR->PFIFO & UART_PFIFO_TXFIFOSIZE_MASK) >> UART_PFIFO_TXFIFOSIZE_SHIFT);
+	uint8_t fifoDepth = UART_FIFO_DEPTH(pConfig->uartNum);
+
+	// Watermarks. RX must stay below the fifo depth, TDRE rises once the fifo drains to the TX one.
+	// The eDMA takes every byte as it arrives: bytes below a higher watermark would never raise a request,
+	// and the idle interrupt, which only drains an empty fifo, would keep firing on them
+	uint8_t rxWatermark = fifoDepth > 1 && !pConfig->useDmaRx ? MIN(MAX(pConfig->rxWatermark, 1), fifoDepth - 1) : 1;
+	uint8_t txWatermark = MIN(pConfig->txWatermark, fifoDepth - 1);
+	pUCR->RWFIFO = UART_RWFIFO_RXWATER(rxWatermark);
+	pUCR->TWFIFO = UART_TWFIFO_TXWATER(txWatermark);
 
 	// Buffer initialization
-	if (pUART->config.transmitBufferSize == 0)
+	if (pUART->config.pTransmitBuffer == 0 || pUART->config.transmitBufferSize == 0)
+	{
+		pUART->config.pTransmitBuffer = defaultTransmitBuffers[pConfig->uartNum];
 		pUART->config.transmitBufferSize = DEFAULT_BUFFER_SIZE;
+	}
 
-	if (pUART->config.receiveBufferSize == 0)
+	if (pUART->config.pReceiveBuffer == 0 || pUART->config.receiveBufferSize == 0)
+	{
+		pUART->config.pReceiveBuffer = defaultReceiveBuffers[pConfig->uartNum];
 		pUART->config.receiveBufferSize = DEFAULT_BUFFER_SIZE;
+	}
+
+	// Rings work on power of two capacities, any excess storage is left unused
+	uint16_t receiveCapacity = RoundDownToPowerOfTwo(pUART->config.receiveBufferSize);
+	uint16_t transmitCapacity = RoundDownToPowerOfTwo(pUART->config.transmitBufferSize);
+	RingBuffer_Init(&pUART->receiveRing, pUART->config.pReceiveBuffer, receiveCapacity);
+	RingBuffer_Init(&pUART->transmitRing, pUART->config.pTransmitBuffer, transmitCapacity);
+
+	// Without its storage the priority lane ring stays zeroed and UART_WritePriority fails
+	if (pUART->config.pPriorityBuffer != 0 && pUART->config.priorityBufferSize != 0)
+	{
+		RingBuffer_Init(&pUART->priorityRing, pUART->config.pPriorityBuffer, RoundDownToPowerOfTwo(pUART->config.priorityBufferSize));
+	}
+
+	pUART->maxFrameSize = pConfig->maxFrameSize ? MIN(pConfig->maxFrameSize, receiveCapacity) : receiveCapacity;
+
+	// RTS follows the receive ring, the fifo watermark only adds the last few bytes of slack
+	pUART->rtsThreshold = pConfig->rtsThreshold ? MIN(pConfig->rtsThreshold, receiveCapacity) : receiveCapacity - receiveCapacity / 4;
+	if (pConfig->useDmaRx)
+	{
+		// The eDMA fill level is only seen every half ring, the next half has to fit after the check
+		pUART->rtsThreshold = MIN(pUART->rtsThreshold, receiveCapacity / 2);
+	}
+	if (pConfig->flowControl)
+	{
+		pUCR->MODEM = UART_MODEM_TXCTSE(1) | UART_MODEM_RXRTSE(1);
+	}
 
-	pUART->pReceiveBuffer = (char*)calloc(pUART->config.receiveBufferSize, 1);
-	pUART->pTransmitBuffer = (char*)calloc(pUART->config.transmitBufferSize, 1);
+	// DMA transmit requests
+	if (pConfig->useDmaTx)
+	{
+		pUCR->C5 |= UART_C5_TDMAS(1);
+	}
+
+	// DMA receive requests. The channel runs forever over the receive buffer and the idle line closes each frame
+	if (pConfig->useDmaRx)
+	{
+		DMA_Transfer transfer = {
+				.pSource = &pUCR->D,
+				.pDestination = pUART->receiveRing.pBuffer,
+				.sourceOffset = 0,
+				.destinationOffset = 1,
+				.count = receiveCapacity,
+				.sourceLastAdjust = 0,
+				.destinationLastAdjust = -(int32_t)receiveCapacity,
+				.disableRequestOnDone = false,
+				// Without an idle line only these interrupts see the ring fill up and throttle the peer
+				.interruptOnDone = pConfig->flowControl,
+				.interruptOnHalf = pConfig->flowControl
+		};
+		DMA_SetupTransfer(pUART->rxDmaChannel, &transfer);
+		DMA_EnableRequest(pUART->rxDmaChannel);
+
+		pUCR->C1 |= UART_C1_ILT(1);
+		pUCR->C5 |= UART_C5_RDMAS(1);
+		pUCR->C2 |= UART_C2_ILIE(1);
+	}
+
+	// Flush whatever is left under the watermark once the line goes idle for a character
+	if (pConfig->rxIdleTimeout && !pConfig->useDmaRx)
+	{
+		pUCR->C1 |= UART_C1_ILT(1);
+		pUCR->C2 |= UART_C2_ILIE(1);
+	}
+
+	// Cycle counter for the interrupt statistics and the coalescing window
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
-	pUART->availableBytes = pUART->config.transmitBufferSize;
+	// Writes that keep coming are checked against the window in core cycles, a one shot timer sends what is held
+	// once no write follows. It is only armed while holding, so an idle link costs no timer wakeups
+	if (pConfig->coalesceMicros != 0)
+	{
+		pUART->coalesceCycles = pConfig->coalesceMicros * (__CORE_CLOCK__ / 1000000u);
+		// The window may differ from the one of a previous Init
+		if (coalesceServiceRegistered[pConfig->uartNum])
+			TimerUnregisterPeriodicInterruption(coalesceServices[pConfig->uartNum]);
+		coalesceServices[pConfig->uartNum] = TimerRegisterOneShot(&UART_CoalesceService, US_TO_TICKS(pConfig->coalesceMicros), (void*)(uintptr_t)pConfig->uartNum);
+		TimerSetEnable(coalesceServices[pConfig->uartNum], false);
+		coalesceServiceRegistered[pConfig->uartNum] = true;
+	}
 
 	// Interrupt Setup
+	pUART->rxInterrupts = UART_C2_RIE_MASK | (pUCR->C2 & UART_C2_ILIE_MASK);
 	pUCR->C2 |= UART_C2_RIE(1);
-	pUCR->C3 |= UART_C3_ORIE(1);
+	pUCR->C3 |= UART_C3_ORIE(1) | UART_C3_FEIE(1) | UART_C3_NEIE(1) | UART_C3_PEIE(1);
 	// Enable transmitter/receiver
 	pUCR->C2 |=	(pConfig->mode == UART_RECEIVER ? UART_C2_RE(1) :
 			( pConfig->mode == UART_TRANSMITTER ? UART_C2_TE(1):(
@@ -283,7 +1148,9 @@ UART_Handle UART_Init(UART_Config* pConfig)
 
 uint16_t UART_PollNewData(UART_Handle handle)
 {
-	return modules[handle]->newDataByteSize;
+	const RingBuffer* pRing = &modules[handle]->receiveRing;
+	uint16_t count = RingBuffer_Count(pRing);
+	return MIN(count, RingBuffer_Capacity(pRing));
 }
 
 char UART_GetChar(UART_Handle handle)
@@ -297,6 +1164,18 @@ char UART_GetChar(UART_Handle handle)
 	return 0;
 }
 
+void UART_Flush(UART_Handle handle)
+{
+	UART* pUART = modules[handle];
+	if (!pUART->holding)
+		return;
+
+	uint32_t primask = UART_EnterCritical();
+	UART_ReleaseHold_Impl(pUART, handle);
+	UART_ExitCritical(primask);
+	UART_StartTransmission(handle);
+}
+
 void UART_PutChar(UART_Handle handle, uint8_t c)
 {
 	// UART Register Pointer
@@ -306,88 +1185,310 @@ void UART_PutChar(UART_Handle handle, uint8_t c)
 	pUCR->D = c;
 }
 
-bool UART_WriteData(UART_Handle handle, const uint8_t* pData, uint8_t size)
+bool UART_WriteData(UART_Handle handle, const uint8_t* pData, uint16_t size)
+{
+	UART_IOVec vec = { pData, size };
+	return UART_WriteV(handle, &vec, 1);
+}
+
+bool UART_WriteString(UART_Handle handle, const char* str)
+{
+	return UART_WriteData(handle, (uint8_t*)str, strlen(str));
+}
+
+bool UART_GetData(UART_Handle handle, uint8_t* pFillData, uint16_t* size, bool* err)
 {
-	// Check if there is room in the buffer
 	UART* pUART = modules[handle];
-	if (pUART->availableBytes < size)
+	RingBuffer* pRing = &pUART->receiveRing;
+
+	if (RingBuffer_DiscardOverrun(pRing))
+		pUART->receiverOverflow = true;
+
+	uint16_t count = RingBuffer_Count(pRing);
+	if (count == 0)
+		return 0;
+	// else
+
+	*size = RingBuffer_Read(pRing, pFillData, count);
+	UART_ResumeReceiver(handle);
+
+	if (pUART->receiverOverflow || pUART->receiveError)
+	{
+		*err = 1;
+		pUART->receiverOverflow = 0;
+		pUART->receiveError = 0;
+	}
+
+	return 1;
+}
+
+bool UART_WriteV(UART_Handle handle, const UART_IOVec* pVec, uint8_t count)
+{
+	UART* pUART = modules[handle];
+	RingBuffer* pRing = &pUART->transmitRing;
+
+	uint32_t totalSize = 0;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		totalSize += pVec[i].size;
+	}
+
+	// The frame gets its own space in one step, so writers from other contexts never interleave with it.
+	// Interrupts stay enabled, the data is published once every writer that reserved before it is done
+	uint16_t position;
+	if (totalSize > RING_BUFFER_MAX_CAPACITY || !RingBuffer_Reserve(pRing, (uint16_t)totalSize, &position))
 	{
 		return 0;
 	}
 
-	// There is room for the data
-	// Copy data to the buffer
-	uint8_t barrier = pUART->transmitBufferBarrier;
-	uint8_t pointer = pUART->transmitBufferPointer;
-	if (barrier >= pointer)
+	// The priority lane can only cut in at the end of the frame. The mark may land after the one of a later reservation
+	if (pUART->priorityRing.pBuffer != 0)
 	{
-		// Copy in two parts
-		uint8_t firstBatchSize = MIN(pUART->config.transmitBufferSize - barrier, size);
-		memcpy(pUART->pTransmitBuffer + barrier, pData, firstBatchSize);
+		uint32_t primask = UART_EnterCritical();
+		UART_PushTxMark_Impl(pUART, position + (uint16_t)totalSize);
+		UART_ExitCritical(primask);
+	}
 
-		// Second Part
-		if (firstBatchSize < size)
-		{
-			uint8_t secondBatchSize = size - firstBatchSize;
-			memcpy(pUART->pTransmitBuffer, pData + firstBatchSize, secondBatchSize);
-		}
+	for (uint8_t i = 0; i < count; i++)
+	{
+		RingBuffer_WriteAtPosition(pRing, position, pVec[i].pData, pVec[i].size);
+		position += pVec[i].size;
 	}
-	else
+	RingBuffer_CommitReserved(pRing);
+	UART_UpdateHighWater_Impl(pRing, &pUART->stats.txHighWater);
+
+	UART_KickTransmission(handle);
+	return 1;
+}
+
+bool UART_WriteAsync(UART_Handle handle, const uint8_t* pData, uint16_t size, callback* pDone, void* user_data)
+{
+	UART* pUART = modules[handle];
+	RingBuffer* pRing = &pUART->transmitRing;
+
+	uint32_t primask = UART_EnterCritical();
+
+	// Critical so the request queue stays in the order of the reservations
+	uint16_t position;
+	uint8_t next = (pUART->writeHead + 1) % UART_ASYNC_WRITE_QUEUE_SIZE;
+	if (next == pUART->writeTail || !RingBuffer_Reserve(pRing, size, &position))
 	{
-		memcpy(pUART->pTransmitBuffer + barrier, pData, size);
+		UART_ExitCritical(primask);
+		return 0;
 	}
 
-	pUART->availableBytes -= size;
-	pUART->transmitBufferBarrier = (pUART->transmitBufferBarrier + size) % pUART->config.transmitBufferSize;
+	RingBuffer_WriteAtPosition(pRing, position, pData, size);
+	UART_PushTxMark_Impl(pUART, position + size);
+	RingBuffer_CommitReserved(pRing);
+	UART_UpdateHighWater_Impl(pRing, &pUART->stats.txHighWater);
 
-	pUART->transmitting = 1;
-	UART_TransmitBuffer_Impl(handle);
+	UARTWrite* pWrite = &pUART->writes[pUART->writeHead];
+	pWrite->end = position + size;
+	pWrite->start = DWT->CYCCNT;
+	pWrite->pCallback = pDone;
+	pWrite->user_data = user_data;
+	pUART->writeHead = next;
+
+	UART_ExitCritical(primask);
 
+	UART_KickTransmission(handle);
 	return 1;
 }
 
-bool UART_WriteString(UART_Handle handle, const char* str)
+bool UART_WriteAddressed(UART_Handle handle, uint8_t address, const uint8_t* pData, uint16_t size)
 {
-	return UART_WriteData(handle, (uint8_t*)str, strlen(str));
+	UART* pUART = modules[handle];
+	RingBuffer* pRing = &pUART->transmitRing;
+
+	uint32_t primask = UART_EnterCritical();
+
+	// Critical so the marks stay in the order of the reservations
+	uint16_t position;
+	uint8_t next = (pUART->addressHead + 1) % UART_ADDRESS_QUEUE_SIZE;
+	if (!pUART->config.multidrop || next == pUART->addressTail || size >= RING_BUFFER_MAX_CAPACITY ||
+			!RingBuffer_Reserve(pRing, size + 1, &position))
+	{
+		UART_ExitCritical(primask);
+		return 0;
+	}
+
+	pUART->addressMarks[pUART->addressHead] = position;
+	RingBuffer_WriteAtPosition(pRing, position, &address, 1);
+	RingBuffer_WriteAtPosition(pRing, position + 1, pData, size);
+	// The mark must be in place before the transmit interrupt can see the bytes
+	pUART->addressHead = next;
+	UART_PushTxMark_Impl(pUART, position + size + 1);
+	RingBuffer_CommitReserved(pRing);
+	UART_UpdateHighWater_Impl(pRing, &pUART->stats.txHighWater);
+
+	UART_ExitCritical(primask);
+
+	UART_KickTransmission(handle);
+	return 1;
 }
 
-bool UART_GetData(UART_Handle handle, uint8_t* pFillData, uint16_t* size, bool* err)
+bool UART_WritePriority(UART_Handle handle, const uint8_t* pData, uint16_t size)
 {
 	UART* pUART = modules[handle];
-	if (!pUART->newData)
+	RingBuffer* pRing = &pUART->priorityRing;
+
+	uint16_t position;
+	if (pRing->pBuffer == 0 || !RingBuffer_Reserve(pRing, size, &position))
+	{
 		return 0;
-	// else
+	}
 
-	uint16_t pointer = pUART->receiveBufferPointer;
-	uint16_t newDataBytes = pUART->newDataByteSize;
-	int16_t offset = pointer - newDataBytes;
+	RingBuffer_WriteAtPosition(pRing, position, pData, size);
+	RingBuffer_CommitReserved(pRing);
 
-	if (offset >= 0)
+	// Never held back by the coalescing window, the held data goes out behind it
+	uint32_t primask = UART_EnterCritical();
+	UART_ReleaseHold_Impl(pUART, handle);
+	UART_ExitCritical(primask);
+	UART_StartTransmission(handle);
+	return 1;
+}
+
+void UART_SetAddress(UART_Handle handle, uint8_t address)
+{
+	modules[handle]->config.address = address;
+	configRegisters[handle]->MA1 = UART_MA1_MA(address);
+}
+
+bool UART_NotifyWritable(UART_Handle handle, uint16_t minFree, callback* pCallback, void* user_data)
+{
+	UART* pUART = modules[handle];
+
+	uint32_t primask = UART_EnterCritical();
+	if (RingBuffer_Free(&pUART->transmitRing) >= minFree)
 	{
-		memcpy(pFillData, pUART->pReceiveBuffer + offset, newDataBytes);
+		UART_ExitCritical(primask);
+		return 1;
 	}
-	else
-	{
-		// Copy "negative offset" part
-		memcpy(pFillData, pUART->pReceiveBuffer + (pUART->config.receiveBufferSize + offset), -offset);
 
-		// Copy other part
-		memcpy(pFillData - offset, pUART->pReceiveBuffer, newDataBytes + offset);
-	}
+	pUART->writableThreshold = minFree;
+	pUART->writableUserData = user_data;
+	pUART->pWritableCallback = pCallback;
+	UART_ExitCritical(primask);
+	return 0;
+}
+
+void UART_GetBaudSetting(UART_Handle handle, UART_BaudSetting* pSetting)
+{
+	*pSetting = modules[handle]->baudSetting;
+}
+
+void UART_GetStats(UART_Handle handle, UART_Stats* pStats)
+{
+	// The interrupts update the counters, copy them all at once
+	uint32_t primask = UART_EnterCritical();
+	*pStats = modules[handle]->stats;
+	UART_ExitCritical(primask);
+}
+
+void UART_ResetStats(UART_Handle handle)
+{
+	UART* pUART = modules[handle];
+
+	uint32_t primask = UART_EnterCritical();
+	memset(&pUART->stats, 0, sizeof(UART_Stats));
+	pUART->stats.rxHighWater = RingBuffer_Count(&pUART->receiveRing);
+	pUART->stats.txHighWater = RingBuffer_Count(&pUART->transmitRing);
+	UART_ExitCritical(primask);
+}
 
-	pUART->newData = 0;
-	*size = pUART->newDataByteSize;
-	pUART->newDataByteSize = 0;
+uint16_t UART_Peek(UART_Handle handle, UART_Span* pFirst, UART_Span* pSecond)
+{
+	UART* pUART = modules[handle];
+	RingBuffer* pRing = &pUART->receiveRing;
+
+	if (RingBuffer_DiscardOverrun(pRing))
+		pUART->receiverOverflow = true;
+
+	RingBuffer_Span first, second;
+	uint16_t count = RingBuffer_Peek(pRing, &first, &second);
 
-	if (pUART->receiverOverflow)
+	pFirst->pData = first.pData;
+	pFirst->size = first.size;
+	pSecond->pData = second.pData;
+	pSecond->size = second.size;
+	return count;
+}
+
+void UART_Consume(UART_Handle handle, uint16_t size)
+{
+	RingBuffer_Consume(&modules[handle]->receiveRing, size);
+	UART_ResumeReceiver(handle);
+}
+
+uint16_t UART_PollFrames(UART_Handle handle)
+{
+	UART* pUART = modules[handle];
+	return (pUART->frameHead + UART_FRAME_QUEUE_SIZE - pUART->frameTail) % UART_FRAME_QUEUE_SIZE;
+}
+
+bool UART_GetFrame(UART_Handle handle, uint8_t* pFillData, uint16_t maxSize, UART_FrameInfo* pInfo)
+{
+	UART* pUART = modules[handle];
+	if (pUART->frameHead == pUART->frameTail)
+		return 0;
+
+	const UARTFrame* pFrame = &pUART->frames[pUART->frameTail];
+	RingBuffer* pRing = &pUART->receiveRing;
+	bool lost = RingBuffer_DiscardOverrun(pRing);
+
+	// Bytes of the frame still in the ring. Part of it may have been taken by UART_GetData or lost to an overrun
+	int16_t pending = (int16_t)(pFrame->end - pRing->tail);
+	if (pending < 0)
+		pending = 0;
+	if (pending > pFrame->size)
 	{
-		*err = 1;
-		pUART->receiverOverflow = 0;
+		// Unframed bytes in front of the frame
+		RingBuffer_Consume(pRing, pending - pFrame->size);
+		pending = pFrame->size;
 	}
 
+	uint16_t size = RingBuffer_Read(pRing, pFillData, MIN((uint16_t)pending, maxSize));
+	RingBuffer_Consume(pRing, pending - size);
+
+	pInfo->size = size;
+	pInfo->overflow = pFrame->overflow || lost || pending < pFrame->size;
+	pInfo->timestamp = pFrame->timestamp;
+
+	pUART->frameTail = (pUART->frameTail + 1) % UART_FRAME_QUEUE_SIZE;
+	UART_ResumeReceiver(handle);
+
 	return 1;
 }
 
+void UART_Delete(UART_Handle handle)
+{
+	UART* pUART = modules[handle];
+	if (pUART == 0)
+		return;
+
+	UART_Type* pUCR = configRegisters[handle];
+
+	// Stop the transmitter, receiver and every interrupt source
+	pUCR->C2 = 0;
+	pUCR->C3 &= ~(UART_C3_ORIE_MASK | UART_C3_FEIE_MASK | UART_C3_NEIE_MASK | UART_C3_PEIE_MASK);
+	pUCR->C5 = 0;
+	pUCR->MODEM = 0;
+	pUCR->C4 &= ~(UART_C4_MAEN1_MASK | UART_C4_MAEN2_MASK);
+	NVIC_DisableIRQ(rxTxIRQs[handle]);
+	NVIC_DisableIRQ(errIRQs[handle]);
+
+	if (coalesceServiceRegistered[handle])
+		TimerSetEnable(coalesceServices[handle], false);
+
+	if (pUART->txDmaChannel >= 0)
+		DMA_ReleaseChannel(pUART->txDmaChannel);
+	if (pUART->rxDmaChannel >= 0)
+		DMA_ReleaseChannel(pUART->rxDmaChannel);
+
+	modules[handle] = 0;
+}
+
 #define UARTX_RX_TX_IRQ_IMPL(x)				\
 __ISR__ UART##x##_RX_TX_IRQHandler(void)	\
 {											\
@@ -11,15 +11,45 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "gpio.h"
+#include "Callback.h"
+#include "RingBuffer.h"
 
 typedef int16_t UART_Handle;
 
+#define UART_DEFAULT_BAUD_TOLERANCE 200u	// 2%
+#define UART_ASYNC_WRITE_QUEUE_SIZE 8		// Pending UART_WriteAsync requests per module, one slot stays empty
+#define UART_ADDRESS_QUEUE_SIZE 8			// Pending UART_WriteAddressed messages per module, one slot stays empty
+#define UART_BROADCAST_ADDRESS 0xFF
+
+// Statically allocates the ring storage for one UART. Use UART_USE_INSTANCE to hand it to a UART_Config
+#define UART_DEFINE_INSTANCE(name, rxSize, txSize)															\
+	_Static_assert((rxSize) > 0 && ((rxSize) & ((rxSize) - 1)) == 0, "UART buffer sizes must be powers of two");	\
+	_Static_assert((txSize) > 0 && ((txSize) & ((txSize) - 1)) == 0, "UART buffer sizes must be powers of two");	\
+	_Static_assert((rxSize) <= RING_BUFFER_MAX_CAPACITY, "UART buffer sizes must fit a ring");				\
+	_Static_assert((txSize) <= RING_BUFFER_MAX_CAPACITY, "UART buffer sizes must fit a ring");				\
+	static uint8_t name##_receiveBuffer[rxSize];															\
+	static uint8_t name##_transmitBuffer[txSize]
+
+#define UART_USE_INSTANCE(config, name)								\
+	do {															\
+		(config).pReceiveBuffer = name##_receiveBuffer;				\
+		(config).receiveBufferSize = sizeof(name##_receiveBuffer);	\
+		(config).pTransmitBuffer = name##_transmitBuffer;			\
+		(config).transmitBufferSize = sizeof(name##_transmitBuffer);\
+	} while (0)
+
 enum UART_Mode {
 	UART_RECEIVER,			// Receiver only function
 	UART_TRANSMITTER,		// Trasmitter only function
 	UART_TRANSCEIVER		// Trasmitter and Receiver function
 };
 
+enum UART_FrameMode {
+	UART_FRAME_IDLE,			// Frames are closed by an idle line, only in eDMA receive mode
+	UART_FRAME_DELIMITER,		// Frames end with frameDelimiter
+	UART_FRAME_LENGTH_PREFIX	// Each frame starts with a byte holding the size of the rest
+};
+
 typedef struct {
 	bool skipPinSetup;
 	pin_t rx;
@@ -31,28 +61,147 @@ typedef struct {
 
 	uint16_t mode;
 
-	uint32_t baudRate; 	// 13 bit register
-	uint8_t brfd;			// Correction factor for the baud rate divider
+	uint32_t baudRate; 		// Bits per second
+	uint16_t baudTolerance;	// Maximum error of the generated rate in hundredths of a percent. 0 uses UART_DEFAULT_BAUD_TOLERANCE
 
-	bool extendedDataBits;	// Set to 0 for the default 8 bit word, true for the extended 9 bit
+	bool extendedDataBits;	// 9 bit word: 8 data bits and the parity bit. The driver has no ninth data bit, so needs parityEnable
+	bool multidrop;			// 9 bit address marked bus. Needs parity and the eDMA transmitter off
+	uint8_t address;		// Station address matched in hardware, messages for other stations never reach the fifo
+	bool acceptBroadcast;	// Also receive messages sent to UART_BROADCAST_ADDRESS
 	bool parityEnable;		// enable/disable parity error detection
 	bool parityType; 		// true for odd, false for even
+	bool loopback;			// Internal loopback, the transmitter feeds the receiver and the RX pin is ignored
+
+	// Storage for the receive and transmit rings. Left null the driver uses its own 64 byte buffers.
+	// Sizes should be powers of two (up to 16384), otherwise only the largest power of two that fits is used
+	uint8_t* pReceiveBuffer;
+	uint8_t* pTransmitBuffer;
+	uint16_t receiveBufferSize;
+	uint16_t transmitBufferSize;
+
+	// High priority transmit lane for UART_WritePriority, same size rules. Left null the module has a single lane
+	uint8_t* pPriorityBuffer;
+	uint16_t priorityBufferSize;
+
+	uint8_t rxWatermark;			// Receive interrupt once this many bytes are in the fifo (clamped below the fifo depth, 1 with useDmaRx)
+	uint8_t txWatermark;			// Refill the transmit fifo once it drains to this many bytes
+	bool rxIdleTimeout;				// Deliver the bytes under the watermark once the line stays idle for a character
+
+	bool flowControl;				// Hardware RTS/CTS on the cts and rts pins
+	uint16_t rtsThreshold;			// Receive ring fill level that deasserts RTS. 0 uses three quarters of the ring, useDmaRx caps it at half
+
+	uint16_t coalesceMicros;		// Hold writes to an idle transmitter up to this long so they go out together. 0 sends right away
+	uint16_t coalesceBytes;			// Send the held data as soon as this many bytes are queued. 0 only uses the window
 
-	uint8_t receiveBufferSize;
-	uint8_t transmitBufferSize;
+	bool useDmaTx;					// Feed the transmitter from the buffer through the eDMA instead of the TX interrupt
+	callback* pTxCompleteCallback;	// Called from interrupt context once the transmit buffer has been drained
+	void* txCompleteUserData;
+
+	bool useDmaRx;					// Stream received bytes through the eDMA and deliver them as frames closed by an idle line
+	callback* pFrameCallback;		// Called from interrupt context every time a frame is completed
+	void* frameUserData;
+
+	uint8_t frameMode;				// UART_FrameMode. The delimiter and the length prefix are not part of the frame
+	uint8_t frameDelimiter;
+	uint16_t maxFrameSize;			// Delimited frames are cut and flagged at this size. 0 uses the receive ring capacity
 } UART_Config;
 
+typedef struct {
+	uint16_t size;		// Bytes copied into the caller buffer
+	bool overflow;		// Frames or bytes were lost before this one
+	uint32_t timestamp;	// DWT CYCCNT when the driver closed the frame. Wraps every 2^32 core cycles
+} UART_FrameInfo;
+
+typedef struct {
+	const uint8_t* pData;
+	uint16_t size;
+} UART_Span;
+
+typedef struct {
+	uint16_t sbr;				// 13 bit integer divider
+	uint8_t brfa;				// Fine adjust, in 1/32 steps of the divider
+	uint32_t achievedBaudRate;
+	uint16_t error;				// |achieved - requested| in hundredths of a percent of the requested rate
+} UART_BaudSetting;
+
+typedef struct {
+	uint32_t rxTxInterrupts;
+	uint32_t errorInterrupts;
+	uint32_t dmaInterrupts;		// Transmit transfers completed and receive progress reported by the eDMA
+	uint32_t dmaErrors;			// Transfers stopped by an eDMA error and restarted
+	uint32_t bytesReceived;
+	uint32_t bytesTransmitted;
+	uint32_t frames;			// Frames closed by the receiver
+	uint32_t overruns;			// Hardware fifo overruns
+	uint32_t droppedBytes;		// Received bytes lost because the receive ring was full
+	uint32_t framingErrors;
+	uint32_t noiseErrors;
+	uint32_t parityErrors;
+	uint16_t rxHighWater;		// Maximum fill level seen on each ring
+	uint16_t txHighWater;
+	uint32_t isrCycles;			// Core cycles spent in the driver interrupts
+	uint32_t isrMaxCycles;		// Longest single interrupt
+	uint32_t asyncWrites;		// UART_WriteAsync requests completed
+	uint32_t writeLatencyLast;	// Core cycles from UART_WriteAsync until the last byte left the shift register
+	uint32_t writeLatencyMax;
+} UART_Stats;
+
+typedef struct {
+	const void* pData;
+	uint16_t size;
+} UART_IOVec;
+
 UART_Handle UART_Init(UART_Config* pConfig);
 
+// Chooses SBR and BRFA for the given module clock. Returns false if the rate is out of range or tolerance
+bool UART_CalculateBaudRate(uint32_t moduleClock, uint32_t baudRate, uint16_t tolerance, UART_BaudSetting* pSetting);
+void UART_GetBaudSetting(UART_Handle handle, UART_BaudSetting* pSetting);
+
 uint16_t UART_PollNewData(UART_Handle handle);
 
 char UART_GetChar(UART_Handle handle);
 bool UART_GetData(UART_Handle handle, uint8_t* pFillData, uint16_t* size, bool* err);
 
+// Zero copy reception. The spans point into the receive buffer and stay valid until UART_Consume
+uint16_t UART_Peek(UART_Handle handle, UART_Span* pFirst, UART_Span* pSecond);
+void UART_Consume(UART_Handle handle, uint16_t size);
+
+// Frame oriented reception, only complete frames are returned. Frames longer than maxSize are truncated.
+// pInfo->timestamp is taken when the frame closes: at the delimiter or length in interrupt mode, at the idle line in DMA mode
+uint16_t UART_PollFrames(UART_Handle handle);
+bool UART_GetFrame(UART_Handle handle, uint8_t* pFillData, uint16_t maxSize, UART_FrameInfo* pInfo);
+
 void UART_PutChar(UART_Handle handle, uint8_t c);
-bool UART_WriteData(UART_Handle handle, const uint8_t* pData, uint8_t size);
+// Sends the writes held by the coalescing window right away
+void UART_Flush(UART_Handle handle);
+bool UART_WriteData(UART_Handle handle, const uint8_t* pData, uint16_t size);
 bool UART_WriteString(UART_Handle handle, const char* str);
 
+// Queues every fragment back to back as a single frame, or nothing if it does not fit. Safe to call from interrupts
+bool UART_WriteV(UART_Handle handle, const UART_IOVec* pVec, uint8_t count);
+
+// Queues the data and calls pDone from interrupt context once its last byte has left the shift register.
+// Returns false if it does not fit or too many writes are pending. Safe to call from interrupts
+bool UART_WriteAsync(UART_Handle handle, const uint8_t* pData, uint16_t size, callback* pDone, void* user_data);
+
+// Queues a frame on the priority lane. It goes out as soon as the frame being sent from the normal lane ends,
+// ahead of the rest of the backlog and of the coalescing window. Carries no multidrop address mark.
+// Returns false without a priority buffer or if it does not fit. Safe to call from interrupts
+bool UART_WritePriority(UART_Handle handle, const uint8_t* pData, uint16_t size);
+
+// Multidrop. Sends the address with the ninth bit set followed by the data. The receiving station gets the
+// address byte in front of the data. Returns false if it does not fit. Safe to call from interrupts
+bool UART_WriteAddressed(UART_Handle handle, uint8_t address, const uint8_t* pData, uint16_t size);
+void UART_SetAddress(UART_Handle handle, uint8_t address);
+
+// Calls pCallback once, from interrupt context, when at least minFree bytes of the transmit buffer are free.
+// Returns true without arming it if there is room already
+bool UART_NotifyWritable(UART_Handle handle, uint16_t minFree, callback* pCallback, void* user_data);
+
+
+// Consistent snapshot of the counters. Reset clears them and restarts the high water marks from the current fill
+void UART_GetStats(UART_Handle handle, UART_Stats* pStats);
+void UART_ResetStats(UART_Handle handle);
 
 void UART_Delete(UART_Handle handle);
 
@@ -0,0 +1,124 @@
+/***************************************************************************//**
+  @file     RingBufferBenchmark.c
+  @brief    Host throughput of the RingBuffer copy paths in bytes per cycle
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "RingBuffer.h"
+#include <stdio.h>
+#include <time.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define RING_CAPACITY	1024u
+#define TOTAL_BYTES		(64u * 1024u * 1024u)
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+static uint8_t storage[RING_CAPACITY];
+static uint8_t source[RING_CAPACITY];
+static uint8_t destination[RING_CAPACITY];
+static RingBuffer ring;
+
+static const uint16_t chunkSizes[] = { 1, 4, 16, 64, 256 };
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+// Time stamp counter where there is one, nanoseconds elsewhere
+static uint64_t Cycles(void)
+{
+#ifdef __x86_64__
+	return __rdtsc();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static double PushPop(void)
+{
+	uint64_t start = Cycles();
+	for (uint32_t i = 0; i < TOTAL_BYTES; i++)
+	{
+		uint8_t data;
+		RingBuffer_Push(&ring, (uint8_t)i);
+		RingBuffer_Pop(&ring, &data);
+		destination[0] ^= data;
+	}
+	return (double)TOTAL_BYTES / (double)(Cycles() - start);
+}
+
+// An odd offset keeps the chunks from lining up with the end of the storage, so some copies wrap
+static double WriteRead(uint16_t chunk)
+{
+	RingBuffer_Reset(&ring);
+	RingBuffer_Push(&ring, 0);
+
+	uint64_t start = Cycles();
+	for (uint32_t sent = 0; sent < TOTAL_BYTES; sent += chunk)
+	{
+		RingBuffer_Write(&ring, source, chunk);
+		RingBuffer_Read(&ring, destination, chunk);
+	}
+	return (double)TOTAL_BYTES / (double)(Cycles() - start);
+}
+
+static double ReserveCommit(uint16_t chunk)
+{
+	RingBuffer_Reset(&ring);
+
+	uint64_t start = Cycles();
+	for (uint32_t sent = 0; sent < TOTAL_BYTES; sent += chunk)
+	{
+		uint16_t position;
+		RingBuffer_Reserve(&ring, chunk, &position);
+		RingBuffer_WriteAtPosition(&ring, position, source, chunk);
+		RingBuffer_CommitReserved(&ring);
+		RingBuffer_Read(&ring, destination, chunk);
+	}
+	return (double)TOTAL_BYTES / (double)(Cycles() - start);
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	RingBuffer_Init(&ring, storage, RING_CAPACITY);
+	for (uint16_t i = 0; i < RING_CAPACITY; i++)
+	{
+		source[i] = (uint8_t)i;
+	}
+
+#ifdef __x86_64__
+	const char* pUnit = "bytes/cycle";
+#else
+	const char* pUnit = "bytes/ns";
+#endif
+
+	printf("Push + Pop          : %6.3f %s\n", PushPop(), pUnit);
+	for (uint8_t i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++)
+	{
+		printf("Write + Read    %4u: %6.3f %s\n", chunkSizes[i], WriteRead(chunkSizes[i]), pUnit);
+	}
+	for (uint8_t i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++)
+	{
+		printf("Reserve + Commit%4u: %6.3f %s\n", chunkSizes[i], ReserveCommit(chunkSizes[i]), pUnit);
+	}
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/***************************************************************************//**
+  @file     RingBufferMPSCTest.c
+  @brief    Host stress test of the multiple producer reservations of RingBuffer
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "RingBuffer.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define PRODUCERS			4
+#define FRAMES_PER_PRODUCER	200000u
+#define RING_CAPACITY		1024u
+
+#define FRAME_MAGIC			0xA0
+#define FRAME_HEADER_SIZE	4		// Magic and producer, size, 16 bit sequence
+#define FRAME_MAX_SIZE		20
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+static uint8_t storage[RING_CAPACITY];
+static RingBuffer ring;
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static uint8_t PayloadByte(uint8_t producer, uint32_t sequence, uint8_t index)
+{
+	return (uint8_t)(sequence * 7 + index + producer);
+}
+
+// Every frame is reserved whole and copied in two parts, sometimes yielding in between, so other producers
+// reserve and commit around a frame that is still being written
+static void* Producer(void* arg)
+{
+	uint8_t producer = (uint8_t)(uintptr_t)arg;
+	unsigned int seed = producer + 1;
+
+	for (uint32_t sequence = 0; sequence < FRAMES_PER_PRODUCER; sequence++)
+	{
+		uint8_t frame[FRAME_MAX_SIZE];
+		uint8_t size = FRAME_HEADER_SIZE + rand_r(&seed) % (FRAME_MAX_SIZE - FRAME_HEADER_SIZE + 1);
+		frame[0] = FRAME_MAGIC | producer;
+		frame[1] = size;
+		frame[2] = (uint8_t)sequence;
+		frame[3] = (uint8_t)(sequence >> 8);
+		for (uint8_t i = FRAME_HEADER_SIZE; i < size; i++)
+		{
+			frame[i] = PayloadByte(producer, sequence, i);
+		}
+
+		uint16_t position;
+		while (!RingBuffer_Reserve(&ring, size, &position))
+		{
+			sched_yield();
+		}
+
+		RingBuffer_WriteAtPosition(&ring, position, frame, FRAME_HEADER_SIZE);
+		if (rand_r(&seed) % 8 == 0)
+			sched_yield();
+		RingBuffer_WriteAtPosition(&ring, position + FRAME_HEADER_SIZE, frame + FRAME_HEADER_SIZE, size - FRAME_HEADER_SIZE);
+		RingBuffer_CommitReserved(&ring);
+	}
+
+	return 0;
+}
+
+static uint8_t PeekByte(uint16_t offset)
+{
+	RingBuffer_Span first, second;
+	RingBuffer_Peek(&ring, &first, &second);
+	return offset < first.size ? first.pData[offset] : second.pData[offset - first.size];
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	RingBuffer_Init(&ring, storage, RING_CAPACITY);
+
+	pthread_t threads[PRODUCERS];
+	for (uintptr_t i = 0; i < PRODUCERS; i++)
+	{
+		pthread_create(&threads[i], 0, Producer, (void*)i);
+	}
+
+	// Published data must always be made of whole frames, in order for each producer
+	uint32_t expected[PRODUCERS] = { 0 };
+	uint32_t frames = 0;
+	while (frames < PRODUCERS * FRAMES_PER_PRODUCER)
+	{
+		if (RingBuffer_Count(&ring) < FRAME_HEADER_SIZE)
+		{
+			sched_yield();
+			continue;
+		}
+
+		uint8_t magic = PeekByte(0);
+		uint8_t size = PeekByte(1);
+		uint8_t producer = magic & 0x0F;
+		if ((magic & 0xF0) != FRAME_MAGIC || producer >= PRODUCERS || size < FRAME_HEADER_SIZE || size > FRAME_MAX_SIZE)
+		{
+			printf("FAIL: bad header %02X size %u after %u frames\n", magic, size, frames);
+			return 1;
+		}
+		if (RingBuffer_Count(&ring) < size)
+		{
+			printf("FAIL: partial frame published after %u frames\n", frames);
+			return 1;
+		}
+
+		uint8_t frame[FRAME_MAX_SIZE];
+		RingBuffer_Read(&ring, frame, size);
+
+		uint16_t sequence = frame[2] | (frame[3] << 8);
+		if (sequence != (uint16_t)expected[producer])
+		{
+			printf("FAIL: producer %u sent %u, expected %u\n", producer, sequence, (uint16_t)expected[producer]);
+			return 1;
+		}
+		for (uint8_t i = FRAME_HEADER_SIZE; i < size; i++)
+		{
+			if (frame[i] != PayloadByte(producer, expected[producer], i))
+			{
+				printf("FAIL: producer %u frame %u corrupted at byte %u\n", producer, expected[producer], i);
+				return 1;
+			}
+		}
+
+		expected[producer]++;
+		frames++;
+	}
+
+	for (int i = 0; i < PRODUCERS; i++)
+	{
+		pthread_join(threads[i], 0);
+	}
+
+	printf("PASS: %u frames from %d producers\n", frames, PRODUCERS);
+	return 0;
+}
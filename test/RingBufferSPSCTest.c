@@ -0,0 +1,139 @@
+/***************************************************************************//**
+  @file     RingBufferSPSCTest.c
+  @brief    Host stress test of the single producer / single consumer RingBuffer
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "RingBuffer.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define TOTAL_BYTES		50000000u
+#define RING_CAPACITY	256u		// Small so the indexes wrap the storage and the 16 bit counters often
+#define MAX_CHUNK		96u
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+static uint8_t storage[RING_CAPACITY];
+static RingBuffer ring;
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static uint8_t PatternByte(uint32_t index)
+{
+	return (uint8_t)(index ^ (index >> 8) ^ (index >> 16));
+}
+
+// Mixes single byte pushes and block writes of random size, the way the UART interrupt and the main loop do
+static void* Producer(void* arg)
+{
+	(void)arg;
+	unsigned int seed = 1;
+	uint32_t sent = 0;
+
+	while (sent < TOTAL_BYTES)
+	{
+		if (rand_r(&seed) % 4 == 0)
+		{
+			if (RingBuffer_Push(&ring, PatternByte(sent)))
+				sent++;
+			else
+				sched_yield();
+			continue;
+		}
+
+		uint8_t chunk[MAX_CHUNK];
+		uint32_t size = 1 + rand_r(&seed) % MAX_CHUNK;
+		if (size > TOTAL_BYTES - sent)
+			size = TOTAL_BYTES - sent;
+		for (uint32_t i = 0; i < size; i++)
+		{
+			chunk[i] = PatternByte(sent + i);
+		}
+
+		uint16_t written = RingBuffer_Write(&ring, chunk, (uint16_t)size);
+		sent += written;
+		if (written == 0)
+			sched_yield();
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	RingBuffer_Init(&ring, storage, RING_CAPACITY);
+
+	pthread_t thread;
+	pthread_create(&thread, 0, Producer, 0);
+
+	// The consumer rotates through every read path and checks each byte against the pattern
+	unsigned int seed = 2;
+	uint32_t received = 0;
+	while (received < TOTAL_BYTES)
+	{
+		uint8_t chunk[MAX_CHUNK];
+		uint16_t size = 0;
+		const uint8_t* pData = chunk;
+
+		switch (rand_r(&seed) % 3)
+		{
+		case 0:
+			size = RingBuffer_Pop(&ring, chunk) ? 1 : 0;
+			break;
+		case 1:
+			size = RingBuffer_Read(&ring, chunk, 1 + rand_r(&seed) % MAX_CHUNK);
+			break;
+		default:
+			size = RingBuffer_PeekContiguous(&ring, &pData);
+			break;
+		}
+
+		if (size == 0)
+		{
+			sched_yield();
+			continue;
+		}
+
+		for (uint16_t i = 0; i < size; i++)
+		{
+			if (pData[i] != PatternByte(received + i))
+			{
+				printf("FAIL: byte %u is %02X, expected %02X\n", received + i, pData[i], PatternByte(received + i));
+				return 1;
+			}
+		}
+
+		if (pData != chunk)
+			RingBuffer_Consume(&ring, size);
+		received += size;
+	}
+
+	pthread_join(thread, 0);
+
+	if (RingBuffer_Count(&ring) != 0)
+	{
+		printf("FAIL: %u bytes left over\n", RingBuffer_Count(&ring));
+		return 1;
+	}
+
+	printf("PASS: %u bytes through a %u byte ring\n", received, RING_CAPACITY);
+	return 0;
+}
@@ -0,0 +1,171 @@
+/***************************************************************************//**
+  @file     TelemetryBurstBenchmark.c
+  @brief    Bursts of telemetry from 7 stations a gateway UART holds while the application is not reading,
+            with the default 64 byte ring and with static instances, on the simulated K64
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "UART.h"
+#include "Telemetry.h"
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define GATEWAY_UART	0u
+#define BAUD_RATE		115200u
+#define STATIONS		7u
+#define MAX_BURSTS		128u
+#define BURST_SIZE_MAX	(STATIONS * TELEMETRY_MAX_FRAME_SIZE)
+
+/*******************************************************************************
+ *                                OBJETOS
+ ******************************************************************************/
+
+// Null buffers leave the driver's default rings
+typedef struct
+{
+	uint8_t* pReceiveBuffer;
+	uint16_t receiveBufferSize;
+	uint8_t* pTransmitBuffer;
+	uint16_t transmitBufferSize;
+} GatewayRing;
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+UART_DEFINE_INSTANCE(gateway512, 512, 64);
+UART_DEFINE_INSTANCE(gateway2048, 2048, 64);
+UART_DEFINE_INSTANCE(gateway8192, 8192, 64);
+
+static const GatewayRing rings[] = {
+	{ 0, 64, 0, 0 },
+	{ gateway512_receiveBuffer, sizeof(gateway512_receiveBuffer), gateway512_transmitBuffer, sizeof(gateway512_transmitBuffer) },
+	{ gateway2048_receiveBuffer, sizeof(gateway2048_receiveBuffer), gateway2048_transmitBuffer, sizeof(gateway2048_transmitBuffer) },
+	{ gateway8192_receiveBuffer, sizeof(gateway8192_receiveBuffer), gateway8192_transmitBuffer, sizeof(gateway8192_transmitBuffer) },
+};
+
+static uint8_t sent[MAX_BURSTS * BURST_SIZE_MAX];
+static uint8_t received[MAX_BURSTS * BURST_SIZE_MAX];
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+// One frame from every station, back to back on the gateway's line. The whole sample, as App.c sends it
+static uint16_t BuildBurst(uint32_t burst, uint8_t* pBurst)
+{
+	uint16_t size = 0;
+	for (uint8_t station = 0; station < STATIONS; station++)
+	{
+		Telemetry_Sample sample = {};
+		sample.station = station;
+		sample.angleMask = TELEMETRY_ANGLE_BIT(TELEMETRY_ROLL) | TELEMETRY_ANGLE_BIT(TELEMETRY_PITCH) | TELEMETRY_ANGLE_BIT(TELEMETRY_YAW);
+		sample.values[TELEMETRY_ROLL] = (float)(burst * 3 + station) - 90.0f;
+		sample.values[TELEMETRY_PITCH] = (float)(burst + station * 5) - 45.0f;
+		sample.values[TELEMETRY_YAW] = (float)(burst * 7 % 360);
+		size += Telemetry_Encode(&sample, pBurst + size);
+	}
+	return size;
+}
+
+// Feeds bursts to a gateway that does not read until the first byte is dropped, then checks the ring
+// gave back exactly what was sent before that burst
+static bool Run(const GatewayRing* pRing, uint32_t* pBursts, uint16_t* pBurstSize)
+{
+	UART_Config config = {};
+	config.skipPinSetup = true;
+	config.uartNum = GATEWAY_UART;
+	config.mode = UART_RECEIVER;
+	config.baudRate = BAUD_RATE;
+	config.rxWatermark = 6;
+	config.rxIdleTimeout = true;
+	config.pReceiveBuffer = pRing->pReceiveBuffer;
+	config.receiveBufferSize = pRing->pReceiveBuffer ? pRing->receiveBufferSize : 0;
+	config.pTransmitBuffer = pRing->pTransmitBuffer;
+	config.transmitBufferSize = pRing->transmitBufferSize;
+	UART_Handle handle = UART_Init(&config);
+	if (handle < 0)
+	{
+		printf("FAIL: the gateway UART did not open\n");
+		return false;
+	}
+
+	uint32_t charCycles = Sim_CharCycles(GATEWAY_UART);
+	uint32_t absorbed = 0, sentBytes = 0;
+	UART_Stats stats = {};
+	for (uint32_t burst = 0; burst < MAX_BURSTS && stats.droppedBytes == 0; burst++)
+	{
+		uint16_t size = BuildBurst(burst, sent + sentBytes);
+		*pBurstSize = size;
+		Sim_Feed(GATEWAY_UART, sent + sentBytes, size);
+		Sim_Run((uint64_t)charCycles * (size + 2));
+		UART_GetStats(handle, &stats);
+		if (stats.droppedBytes == 0)
+		{
+			absorbed++;
+			sentBytes += size;
+		}
+	}
+
+	// Whatever made it in must be the bursts that fit, in order
+	uint32_t receivedBytes = 0;
+	uint16_t size;
+	bool err = false;
+	while (receivedBytes < sizeof(received) && UART_GetData(handle, received + receivedBytes, &size, &err))
+	{
+		receivedBytes += size;
+	}
+	UART_Delete(handle);
+
+	if (receivedBytes < sentBytes || memcmp(received, sent, sentBytes) != 0)
+	{
+		printf("FAIL: a %u byte ring gave back %u bytes that are not the %u sent\n", pRing->receiveBufferSize, receivedBytes, sentBytes);
+		return false;
+	}
+	*pBursts = absorbed;
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	Sim_Reset();
+
+	uint32_t defaultBursts = 0;
+	for (uint8_t r = 0; r < sizeof(rings) / sizeof(rings[0]); r++)
+	{
+		uint32_t bursts;
+		uint16_t burstSize;
+		if (!Run(&rings[r], &bursts, &burstSize))
+			return 1;
+		if (r == 0)
+			defaultBursts = bursts;
+
+		printf("%-8s %5u byte receive ring: %2u bursts of %u bytes from %u stations held before the first overflow%s\n",
+				rings[r].pReceiveBuffer ? "instance" : "default", rings[r].receiveBufferSize, bursts, burstSize, STATIONS,
+				bursts == MAX_BURSTS ? " (the most tried)" : "");
+		if (r != 0 && bursts <= defaultBursts)
+		{
+			printf("FAIL: a %u byte ring held no more than the default\n", rings[r].receiveBufferSize);
+			return 1;
+		}
+	}
+
+	if (Sim_Storms() != 0)
+	{
+		printf("FAIL: %u interrupt storms\n", Sim_Storms());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+/***************************************************************************//**
+  @file     TimerTickBenchmark.c
+  @brief    The board's timer benchmark (app/TimerBenchmark.c) run unchanged on the simulated K64, with the host
+            time of the tick interrupt as the number of services grows. It is built with Sleep as Sim_Sleep,
+            which lets the simulated time go by, once with the SysTick and once with -DTIMER_TICKLESS
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "Timer.h"
+#include "TimerBenchmark.h"
+#include <stdio.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define DURATION_MS		1000u
+#define RUNS			4u
+
+#ifdef TIMER_TICKLESS
+#define TIMER_IRQ		PIT2_IRQn
+#define BUILD_NAME		"tickless"
+#else
+#define TIMER_IRQ		SysTick_IRQn
+#define BUILD_NAME		"SysTick"
+#endif
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+// The runs App.c makes with TIMER_BENCHMARK: idle services with a period longer than the run, then a busy set
+static const uint16_t services[RUNS] = { 1, 16, 256, 16 };
+static const uint32_t periods[RUNS] = { 10000, 10000, 10000, 10 };
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+void Sim_Sleep(ticks dt)
+{
+	Sim_Run(dt * (__CORE_CLOCK__ / TICKS_PER_SECOND));
+}
+
+int main(void)
+{
+	Sim_Reset();
+	TimerInit();
+
+	for (uint8_t i = 0; i < RUNS; i++)
+	{
+		Sim_ResetIRQStats();
+		TimerBenchmark_Result result;
+		if (!TimerBenchmark_Run(services[i], periods[i], DURATION_MS, &result))
+		{
+			printf("FAIL: the run with %u services did not start\n", services[i]);
+			return 1;
+		}
+
+		// The driver's own count must be what the interrupt controller saw
+		const SimIRQStats* pTick = Sim_IRQStats(TIMER_IRQ);
+		printf("%-8s %3u services every %5u ms: %4u interrupts/s, %5u callbacks, %7.1f host cycles per interrupt\n",
+				BUILD_NAME, services[i], periods[i], result.interruptsPerSecond, result.callbacks,
+				pTick->calls ? (double)pTick->hostCycles / pTick->calls : 0.0);
+		if (pTick->calls != result.interrupts)
+		{
+			printf("FAIL: the timer counted %u interrupts, %u were taken\n", result.interrupts, pTick->calls);
+			return 1;
+		}
+	}
+
+	if (Sim_Storms() != 0)
+	{
+		printf("FAIL: %u interrupt storms\n", Sim_Storms());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,185 @@
+/***************************************************************************//**
+  @file     UARTBaudRateTest.c
+  @brief    Table test of UART_CalculateBaudRate: standard rates at 60 and 120 MHz against the best divider found
+            by trying them all, rates out of the divider's range and the tolerance check
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "UART.h"
+#include <stdio.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define MIN_DIVIDER		32u				// SBR 1, BRFA 0, in 1/32 steps
+#define MAX_DIVIDER		0x3FFFFu		// SBR 0x1FFF, BRFA 31
+#define NO_TOLERANCE	UINT16_MAX
+
+/*******************************************************************************
+ *                                OBJETOS
+ ******************************************************************************/
+
+typedef struct
+{
+	uint32_t moduleClock;
+	uint32_t baudRate;
+	uint16_t sbr;
+	uint8_t brfa;
+	uint32_t achievedBaudRate;
+	uint16_t error;			// Hundredths of a percent
+} BaudCase;
+
+typedef struct
+{
+	uint32_t moduleClock;
+	uint32_t baudRate;
+	uint16_t tolerance;
+	bool accepted;
+} LimitCase;
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+static const BaudCase standardRates[] = {
+	{ 60000000, 1200, 3125, 0, 1200, 0 },
+	{ 60000000, 2400, 1562, 16, 2400, 0 },
+	{ 60000000, 4800, 781, 8, 4800, 0 },
+	{ 60000000, 9600, 390, 20, 9600, 0 },
+	{ 60000000, 19200, 195, 10, 19200, 0 },
+	{ 60000000, 38400, 97, 21, 38400, 0 },
+	{ 60000000, 57600, 65, 3, 57609, 2 },
+	{ 60000000, 115200, 32, 18, 115163, 3 },
+	{ 60000000, 230400, 16, 9, 230326, 3 },
+	{ 60000000, 460800, 8, 4, 461538, 16 },
+	{ 60000000, 921600, 4, 2, 923077, 16 },
+	{ 60000000, 1000000, 3, 24, 1000000, 0 },
+	{ 60000000, 1500000, 2, 16, 1500000, 0 },
+	{ 60000000, 3000000, 1, 8, 3000000, 0 },
+	{ 120000000, 1200, 6250, 0, 1200, 0 },
+	{ 120000000, 2400, 3125, 0, 2400, 0 },
+	{ 120000000, 4800, 1562, 16, 4800, 0 },
+	{ 120000000, 9600, 781, 8, 9600, 0 },
+	{ 120000000, 19200, 390, 20, 19200, 0 },
+	{ 120000000, 38400, 195, 10, 38400, 0 },
+	{ 120000000, 57600, 130, 7, 57595, 1 },
+	{ 120000000, 115200, 65, 3, 115218, 2 },
+	{ 120000000, 230400, 32, 18, 230326, 3 },
+	{ 120000000, 460800, 16, 9, 460653, 3 },
+	{ 120000000, 921600, 8, 4, 923077, 16 },
+	{ 120000000, 1000000, 7, 16, 1000000, 0 },
+	{ 120000000, 1500000, 5, 0, 1500000, 0 },
+	{ 120000000, 3000000, 2, 16, 3000000, 0 },
+};
+
+static const LimitCase limits[] = {
+	// Out of the divider's range
+	{ 60000000, 0, NO_TOLERANCE, false },
+	{ 120000000, 0, NO_TOLERANCE, false },
+	{ 60000000, 4000000, NO_TOLERANCE, false },		// Below SBR 1
+	{ 120000000, 8000000, NO_TOLERANCE, false },
+	{ 120000000, 7500000, NO_TOLERANCE, true },		// clock / 16, SBR 1 exactly
+	{ 120000000, 100, NO_TOLERANCE, false },		// Above SBR 0x1FFF
+	{ 60000000, 450, NO_TOLERANCE, false },
+	{ 60000000, 458, NO_TOLERANCE, true },
+	// 3.5 Mbaud at 60 MHz is 0.84% off
+	{ 60000000, 3500000, UART_DEFAULT_BAUD_TOLERANCE, true },
+	{ 60000000, 3500000, 84, true },
+	{ 60000000, 3500000, 83, false },
+	{ 60000000, 3500000, 50, false },
+	{ 120000000, 921600, 15, false },
+	{ 120000000, 921600, 16, true },
+};
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static uint32_t Achieved(uint32_t moduleClock, uint32_t divider)
+{
+	return (uint32_t)((2 * (uint64_t)moduleClock + divider / 2) / divider);
+}
+
+// Smallest distance to the requested rate over every divider the module has
+static uint32_t BestDifference(uint32_t moduleClock, uint32_t baudRate)
+{
+	uint32_t best = UINT32_MAX;
+	for (uint32_t divider = MIN_DIVIDER; divider <= MAX_DIVIDER; divider++)
+	{
+		uint32_t achieved = Achieved(moduleClock, divider);
+		uint32_t difference = achieved > baudRate ? achieved - baudRate : baudRate - achieved;
+		if (difference < best)
+			best = difference;
+	}
+	return best;
+}
+
+static bool CheckStandardRate(const BaudCase* pCase)
+{
+	UART_BaudSetting setting;
+	if (!UART_CalculateBaudRate(pCase->moduleClock, pCase->baudRate, UART_DEFAULT_BAUD_TOLERANCE, &setting))
+	{
+		printf("FAIL: %u baud at %u Hz was rejected\n", pCase->baudRate, pCase->moduleClock);
+		return false;
+	}
+	if (setting.sbr != pCase->sbr || setting.brfa != pCase->brfa || setting.achievedBaudRate != pCase->achievedBaudRate ||
+			setting.error != pCase->error)
+	{
+		printf("FAIL: %u baud at %u Hz gave SBR %u BRFA %u, %u baud %u error, expected SBR %u BRFA %u, %u baud %u error\n",
+				pCase->baudRate, pCase->moduleClock, setting.sbr, setting.brfa, setting.achievedBaudRate, setting.error,
+				pCase->sbr, pCase->brfa, pCase->achievedBaudRate, pCase->error);
+		return false;
+	}
+
+	// The setting must be what the hardware makes of it, and no other divider may come closer
+	uint32_t achieved = Achieved(pCase->moduleClock, 32u * setting.sbr + setting.brfa);
+	uint32_t difference = achieved > pCase->baudRate ? achieved - pCase->baudRate : pCase->baudRate - achieved;
+	uint32_t best = BestDifference(pCase->moduleClock, pCase->baudRate);
+	if (achieved != setting.achievedBaudRate || difference != best)
+	{
+		printf("FAIL: %u baud at %u Hz is %u baud off, the best divider is %u off\n", pCase->baudRate, pCase->moduleClock, difference, best);
+		return false;
+	}
+	return true;
+}
+
+static bool CheckLimit(const LimitCase* pCase)
+{
+	UART_BaudSetting setting;
+	if (UART_CalculateBaudRate(pCase->moduleClock, pCase->baudRate, pCase->tolerance, &setting) != pCase->accepted)
+	{
+		printf("FAIL: %u baud at %u Hz with a %u tolerance was %s\n", pCase->baudRate, pCase->moduleClock, pCase->tolerance,
+				pCase->accepted ? "rejected" : "accepted");
+		return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	uint32_t standardCount = sizeof(standardRates) / sizeof(standardRates[0]);
+	uint32_t limitCount = sizeof(limits) / sizeof(limits[0]);
+
+	for (uint32_t i = 0; i < standardCount; i++)
+	{
+		if (!CheckStandardRate(&standardRates[i]))
+			return 1;
+	}
+	for (uint32_t i = 0; i < limitCount; i++)
+	{
+		if (!CheckLimit(&limits[i]))
+			return 1;
+	}
+
+	printf("PASS: %u standard rates at 60 and 120 MHz and %u limits\n", standardCount, limitCount);
+	return 0;
+}
@@ -0,0 +1,257 @@
+/***************************************************************************//**
+  @file     UARTDMATransmitTest.c
+  @brief    Interrupt load of the UART transmitter with and without the eDMA, and recovery from eDMA errors,
+            on the simulated K64
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "UART.h"
+#include <stdio.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define BAUD_RATE		115200u
+#define TOTAL_BYTES		16384u
+#define WRITE_SIZE		256u
+#define ERROR_BYTES		4096u
+#define FRAME_SIZE		128u
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+UART_DEFINE_INSTANCE(transmitterBuffers, 64, 1024);
+UART_DEFINE_INSTANCE(receiverBuffers, 1024, 64);
+
+static uint8_t source[TOTAL_BYTES];
+static uint16_t captured[TOTAL_BYTES];
+static uint8_t received[1024];
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static uint8_t PatternByte(uint32_t index)
+{
+	return (uint8_t)(index ^ (index >> 8) ^ (index >> 5));
+}
+
+static UART_Handle Open(uint8_t uartNum, uint16_t mode, bool useDma)
+{
+	UART_Config config = {};
+	config.skipPinSetup = true;
+	config.uartNum = uartNum;
+	config.mode = mode;
+	config.baudRate = BAUD_RATE;
+	if (mode == UART_TRANSMITTER)
+	{
+		config.useDmaTx = useDma;
+		UART_USE_INSTANCE(config, transmitterBuffers);
+	}
+	else
+	{
+		config.useDmaRx = useDma;
+		UART_USE_INSTANCE(config, receiverBuffers);
+	}
+	return UART_Init(&config);
+}
+
+// Handler calls and host time of every UART and eDMA interrupt
+static void DriverInterrupts(uint32_t* pCalls, uint64_t* pCycles)
+{
+	*pCalls = 0;
+	*pCycles = 0;
+	for (int irq = DMA0_IRQn; irq <= UART5_ERR_IRQn; irq++)
+	{
+		*pCalls += Sim_IRQStats(irq)->calls;
+		*pCycles += Sim_IRQStats(irq)->hostCycles;
+	}
+}
+
+static bool CheckCapture(uint8_t uartNum, uint32_t size)
+{
+	uint32_t count = Sim_Captured(uartNum, captured, TOTAL_BYTES);
+	if (count != size)
+	{
+		printf("FAIL: UART%u sent %u bytes, expected %u\n", uartNum, count, size);
+		return false;
+	}
+	for (uint32_t i = 0; i < size; i++)
+	{
+		if (captured[i] != source[i])
+		{
+			printf("FAIL: UART%u byte %u is %02X, expected %02X\n", uartNum, i, captured[i], source[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Writes the whole pattern as fast as the ring takes it and waits for the last byte to leave
+static bool Transmit(bool useDma, uint32_t* pInterrupts)
+{
+	UART_Handle handle = Open(0, UART_TRANSMITTER, useDma);
+	if (handle < 0)
+	{
+		printf("FAIL: UART0 did not open\n");
+		return false;
+	}
+
+	Sim_ClearCapture(0);
+	Sim_ResetIRQStats();
+	uint32_t charCycles = Sim_CharCycles(0);
+	uint64_t deadline = Sim_Now() + (uint64_t)charCycles * TOTAL_BYTES * 4;
+	uint32_t sent = 0;
+	while (Sim_Captured(0, 0, 0) < TOTAL_BYTES && Sim_Now() < deadline)
+	{
+		if (sent < TOTAL_BYTES && UART_WriteData(handle, source + sent, WRITE_SIZE))
+			sent += WRITE_SIZE;
+		else
+			Sim_Run(charCycles * 16);
+	}
+
+	uint32_t calls;
+	uint64_t cycles;
+	DriverInterrupts(&calls, &cycles);
+	UART_Stats stats;
+	UART_GetStats(handle, &stats);
+	UART_Delete(handle);
+
+	printf("%-4s transmit: %5u interrupts for %u bytes, %6.3f per byte, %7.1f host cycles per byte in handlers\n",
+			useDma ? "eDMA" : "IRQ", calls, TOTAL_BYTES, (double)calls / TOTAL_BYTES, (double)cycles / TOTAL_BYTES);
+
+	if (!CheckCapture(0, TOTAL_BYTES))
+		return false;
+	if (stats.bytesTransmitted != TOTAL_BYTES || stats.dmaErrors != 0)
+	{
+		printf("FAIL: stats report %u bytes and %u eDMA errors\n", stats.bytesTransmitted, stats.dmaErrors);
+		return false;
+	}
+	*pInterrupts = calls;
+	return true;
+}
+
+// UART0 transmits through the eDMA while UART1 receives through it. Each channel fails once, only its own
+// transfer stops and its owner picks it up where it was
+static bool RecoverFromErrors(void)
+{
+	UART_Handle transmitter = Open(0, UART_TRANSMITTER, true);
+	UART_Handle receiver = Open(1, UART_RECEIVER, true);
+	if (transmitter < 0 || receiver < 0)
+	{
+		printf("FAIL: UART0 and UART1 did not open\n");
+		return false;
+	}
+
+	Sim_ClearCapture(0);
+	int8_t txChannel = Sim_DmaChannelFor((uint8_t)kDmaRequestMux0UART0Tx);
+	int8_t rxChannel = Sim_DmaChannelFor((uint8_t)kDmaRequestMux0UART1Rx);
+	uint32_t charCycles = Sim_CharCycles(0);
+	uint64_t deadline = Sim_Now() + (uint64_t)charCycles * ERROR_BYTES * 4;
+
+	uint32_t sent = 0, fed = 0, receivedBytes = 0;
+	bool txFailed = false, rxFailed = false;
+	while ((Sim_Captured(0, 0, 0) < ERROR_BYTES || receivedBytes < ERROR_BYTES) && Sim_Now() < deadline)
+	{
+		if (sent < ERROR_BYTES && UART_WriteData(transmitter, source + sent, WRITE_SIZE))
+			sent += WRITE_SIZE;
+
+		// Frames with an idle line in between, the next one once the previous was delivered
+		if (fed < ERROR_BYTES && Sim_FeedPending(1) == 0 && receivedBytes == fed)
+		{
+			Sim_Feed(1, source + fed, FRAME_SIZE);
+			fed += FRAME_SIZE;
+		}
+
+		Sim_Run(charCycles * 4);
+
+		uint16_t size;
+		bool err = false;
+		if (UART_GetData(receiver, received, &size, &err))
+		{
+			for (uint16_t i = 0; i < size; i++)
+			{
+				if (received[i] != source[receivedBytes + i])
+				{
+					printf("FAIL: UART1 byte %u is %02X, expected %02X\n", receivedBytes + i, received[i], source[receivedBytes + i]);
+					return false;
+				}
+			}
+			receivedBytes += size;
+		}
+
+		if (!txFailed && Sim_Captured(0, 0, 0) >= ERROR_BYTES / 4)
+		{
+			Sim_InjectDmaError(txChannel);
+			txFailed = true;
+		}
+		if (!rxFailed && receivedBytes >= ERROR_BYTES / 2)
+		{
+			Sim_InjectDmaError(rxChannel);
+			rxFailed = true;
+		}
+	}
+
+	UART_Stats txStats, rxStats;
+	UART_GetStats(transmitter, &txStats);
+	UART_GetStats(receiver, &rxStats);
+	UART_Delete(transmitter);
+	UART_Delete(receiver);
+
+	if (!CheckCapture(0, ERROR_BYTES))
+		return false;
+	if (receivedBytes != ERROR_BYTES)
+	{
+		printf("FAIL: UART1 received %u bytes, expected %u\n", receivedBytes, ERROR_BYTES);
+		return false;
+	}
+	if (txStats.dmaErrors != 1 || rxStats.dmaErrors != 1)
+	{
+		printf("FAIL: %u transmit and %u receive eDMA errors reported, expected one each\n", txStats.dmaErrors, rxStats.dmaErrors);
+		return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	Sim_Reset();
+	for (uint32_t i = 0; i < TOTAL_BYTES; i++)
+	{
+		source[i] = PatternByte(i);
+	}
+
+	uint32_t interruptCalls, dmaCalls;
+	if (!Transmit(false, &interruptCalls) || !Transmit(true, &dmaCalls))
+		return 1;
+
+	// The TX interrupt refills the 8 byte fifo, the eDMA only interrupts once per contiguous run of the ring
+	if (dmaCalls * 32 > interruptCalls)
+	{
+		printf("FAIL: the eDMA took %u interrupts, the TX interrupt %u\n", dmaCalls, interruptCalls);
+		return 1;
+	}
+
+	if (!RecoverFromErrors())
+		return 1;
+
+	if (Sim_Storms() != 0)
+	{
+		printf("FAIL: %u interrupt storms\n", Sim_Storms());
+		return 1;
+	}
+
+	printf("PASS: %u bytes with %u interrupts through the eDMA, %u through the TX interrupt, eDMA errors recovered\n",
+			TOTAL_BYTES, dmaCalls, interruptCalls);
+	return 0;
+}
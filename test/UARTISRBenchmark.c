@@ -0,0 +1,156 @@
+/***************************************************************************//**
+  @file     UARTISRBenchmark.c
+  @brief    Host time of the UART interrupt handlers per byte, on the simulated K64. Built once with the paths
+            specialized per module and once with -DUART_GENERIC_ISR, a single copy that looks the module up
+            at runtime. The register model costs the same in both, the difference is the driver's
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "UART.h"
+#include <stdio.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define BAUD_RATE		115200u
+#define TOTAL_BYTES		16384u
+#define WRITE_SIZE		256u
+#define REPEATS			5u		// The best run is reported, the others carry the host's noise
+
+#ifdef UART_GENERIC_ISR
+#define BUILD_NAME		"generic"
+#else
+#define BUILD_NAME		"specialized"
+#endif
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+UART_DEFINE_INSTANCE(benchmarkBuffers, 1024, 1024);
+
+// UART0 has an 8 byte fifo, UART3 a single data register
+static const uint8_t uartNums[] = { 0, 3 };
+static const IRQn_Type rxTxIRQs[] = UART_RX_TX_IRQS;
+
+static uint8_t source[TOTAL_BYTES];
+static uint16_t captured[TOTAL_BYTES];
+static uint8_t received[1024];
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static uint8_t PatternByte(uint32_t index)
+{
+	return (uint8_t)(index * 7 + (index >> 7));
+}
+
+// Receives and transmits the pattern at the same time, every byte through the interrupts
+static bool Run(uint8_t uartNum, uint32_t* pCalls, uint64_t* pCycles)
+{
+	UART_Config config = {};
+	config.skipPinSetup = true;
+	config.uartNum = uartNum;
+	config.mode = UART_TRANSCEIVER;
+	config.baudRate = BAUD_RATE;
+	UART_USE_INSTANCE(config, benchmarkBuffers);
+	UART_Handle handle = UART_Init(&config);
+	if (handle < 0)
+	{
+		printf("FAIL: UART%u did not open\n", uartNum);
+		return false;
+	}
+
+	Sim_ClearCapture(uartNum);
+	Sim_ResetIRQStats();
+	Sim_Feed(uartNum, source, TOTAL_BYTES);
+	uint32_t charCycles = Sim_CharCycles(uartNum);
+	uint64_t deadline = Sim_Now() + (uint64_t)charCycles * TOTAL_BYTES * 4;
+	uint32_t sent = 0, receivedBytes = 0;
+	while ((Sim_Captured(uartNum, 0, 0) < TOTAL_BYTES || receivedBytes < TOTAL_BYTES) && Sim_Now() < deadline)
+	{
+		if (sent < TOTAL_BYTES && UART_WriteData(handle, source + sent, WRITE_SIZE))
+			sent += WRITE_SIZE;
+
+		Sim_Run(charCycles * 16);
+
+		uint16_t size;
+		bool err = false;
+		if (UART_GetData(handle, received, &size, &err))
+		{
+			for (uint16_t i = 0; i < size; i++)
+			{
+				if (received[i] != source[receivedBytes + i])
+				{
+					printf("FAIL: UART%u byte %u is %02X, expected %02X\n", uartNum, receivedBytes + i, received[i], source[receivedBytes + i]);
+					return false;
+				}
+			}
+			receivedBytes += size;
+		}
+	}
+
+	const SimIRQStats* pRxTx = Sim_IRQStats(rxTxIRQs[uartNum]);
+	*pCalls = pRxTx->calls;
+	*pCycles = pRxTx->hostCycles;
+	UART_Delete(handle);
+
+	uint32_t count = Sim_Captured(uartNum, captured, TOTAL_BYTES);
+	if (receivedBytes != TOTAL_BYTES || count != TOTAL_BYTES)
+	{
+		printf("FAIL: UART%u received %u and sent %u bytes, expected %u\n", uartNum, receivedBytes, count, TOTAL_BYTES);
+		return false;
+	}
+	for (uint32_t i = 0; i < TOTAL_BYTES; i++)
+	{
+		if (captured[i] != source[i])
+		{
+			printf("FAIL: UART%u sent %02X as byte %u, expected %02X\n", uartNum, captured[i], i, source[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	Sim_Reset();
+	for (uint32_t i = 0; i < TOTAL_BYTES; i++)
+	{
+		source[i] = PatternByte(i);
+	}
+
+	for (uint8_t u = 0; u < sizeof(uartNums); u++)
+	{
+		uint32_t calls = 0;
+		uint64_t best = UINT64_MAX;
+		for (uint8_t r = 0; r < REPEATS; r++)
+		{
+			uint64_t cycles;
+			if (!Run(uartNums[u], &calls, &cycles))
+				return 1;
+			if (cycles < best)
+				best = cycles;
+		}
+
+		printf("%-11s UART%u: %6u RX/TX interrupts, %7.1f host cycles per interrupt, %6.1f per byte each way\n",
+				BUILD_NAME, uartNums[u], calls, (double)best / calls, (double)best / TOTAL_BYTES);
+	}
+
+	if (Sim_Storms() != 0)
+	{
+		printf("FAIL: %u interrupt storms\n", Sim_Storms());
+		return 1;
+	}
+	return 0;
+}
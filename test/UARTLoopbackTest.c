@@ -0,0 +1,88 @@
+/***************************************************************************//**
+  @file     UARTLoopbackTest.c
+  @brief    The board's UART loopback benchmark (app/UARTBenchmark.c) run unchanged on the simulated K64.
+            It is built with Now as Sim_PollNow, so its busy loop lets the simulated time go by
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "Timer.h"
+#include "UART.h"
+#include "UARTBenchmark.h"
+#include <stdio.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define BAUD_RATE		115200u
+#define DURATION_MS		2000u
+#define POLL_CYCLES		100u		// Core cycles a pass of the benchmark loop takes, about what the board spends
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+// UART1 has an 8 byte fifo, UART3 a single data register
+static const uint8_t uartNums[] = { 1, 3 };
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static bool Run(uint8_t uartNum)
+{
+	UARTBenchmark_Result result;
+	if (!UARTBenchmark_Run(uartNum, BAUD_RATE, DURATION_MS, &result))
+	{
+		printf("FAIL: UART%u did not open\n", uartNum);
+		return false;
+	}
+
+	printf("UART%u loopback at %u baud: %6u bytes/s, %6u sent, %u lost, %u bad packets, %5u interrupts, "
+			"latency %u/%u/%u cycles min/avg/max\n", uartNum, BAUD_RATE, result.bytesPerSecond, result.bytesSent,
+			result.lostBytes, result.badPackets, result.interrupts, result.minLatency, result.avgLatency, result.maxLatency);
+
+	// Ten bits a character: the line must stay nearly full, with nothing lost on the way
+	uint32_t lineRate = BAUD_RATE / 10;
+	if (result.lostBytes != 0 || result.badPackets != 0 || result.bytesPerSecond < lineRate * 9 / 10)
+	{
+		printf("FAIL: UART%u should carry about %u bytes/s without losses\n", uartNum, lineRate);
+		return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+ticks Sim_PollNow(void)
+{
+	Sim_Run(POLL_CYCLES);
+	return Now();
+}
+
+int main(void)
+{
+	Sim_Reset();
+	TimerInit();
+
+	for (uint8_t u = 0; u < sizeof(uartNums); u++)
+	{
+		if (!Run(uartNums[u]))
+			return 1;
+	}
+
+	if (Sim_Storms() != 0)
+	{
+		printf("FAIL: %u interrupt storms\n", Sim_Storms());
+		return 1;
+	}
+
+	printf("PASS: the loopback benchmark ran on UART1 and UART3\n");
+	return 0;
+}
@@ -0,0 +1,230 @@
+/***************************************************************************//**
+  @file     UARTMultidropTest.c
+  @brief    9 bit multidrop bus with hardware address match, on the simulated K64. UART0 is the master,
+            UART1 to UART3 are stations 1 to 3 and every transmitter drives every other receiver
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "UART.h"
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define BAUD_RATE		115200u
+#define NODES			4u
+#define MASTER			0u
+#define MASTER_ADDRESS	0x10u
+#define BROADCAST_NODE	2u		// The only station that takes broadcasts
+#define MESSAGE_SIZE	40u
+#define ROUNDS			20u
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+UART_DEFINE_INSTANCE(busBuffers, 256, 256);
+
+static const IRQn_Type rxTxIRQs[] = UART_RX_TX_IRQS;
+static UART_Handle handles[NODES];
+static uint8_t addresses[NODES] = { MASTER_ADDRESS, 1, 2, 3 };
+
+static uint8_t message[MESSAGE_SIZE];
+static uint8_t received[256];
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static UART_Handle Open(uint8_t uartNum, uint8_t address, bool acceptBroadcast)
+{
+	UART_Config config = {};
+	config.skipPinSetup = true;
+	config.uartNum = uartNum;
+	config.mode = UART_TRANSCEIVER;
+	config.baudRate = BAUD_RATE;
+	config.multidrop = true;
+	config.address = address;
+	config.acceptBroadcast = acceptBroadcast;
+	UART_USE_INSTANCE(config, busBuffers);
+	return UART_Init(&config);
+}
+
+static void FillMessage(uint8_t to, uint8_t round)
+{
+	for (uint8_t i = 0; i < MESSAGE_SIZE; i++)
+	{
+		message[i] = (uint8_t)(to * 31 + round * 7 + i);
+	}
+}
+
+// Waits for the bus to go quiet: every transmitter empty and a few characters of idle line
+static void Settle(void)
+{
+	uint32_t charCycles = Sim_CharCycles(MASTER);
+	Sim_Run((uint64_t)charCycles * (MESSAGE_SIZE + 2) * 2);
+}
+
+// What the node received must be the address byte followed by the message, and nothing else
+static bool Expect(uint8_t node, uint8_t address, bool present)
+{
+	uint16_t size = 0;
+	bool err = false;
+	if (!UART_GetData(handles[node], received, &size, &err))
+		size = 0;
+
+	uint16_t expected = present ? MESSAGE_SIZE + 1 : 0;
+	if (size != expected || err)
+	{
+		printf("FAIL: node %u received %u bytes, expected %u\n", node, size, expected);
+		return false;
+	}
+	if (present && (received[0] != address || memcmp(received + 1, message, MESSAGE_SIZE) != 0))
+	{
+		printf("FAIL: node %u received the wrong message, address %02X\n", node, received[0]);
+		return false;
+	}
+	return true;
+}
+
+// The sender talks to one address. Only the nodes it is meant for may receive it or take an interrupt for it
+static bool Send(uint8_t from, uint8_t address, uint8_t round)
+{
+	FillMessage(address, round);
+	Sim_ResetIRQStats();
+	if (!UART_WriteAddressed(handles[from], address, message, MESSAGE_SIZE))
+	{
+		printf("FAIL: node %u could not queue a message for %02X\n", from, address);
+		return false;
+	}
+	Settle();
+
+	for (uint8_t node = 0; node < NODES; node++)
+	{
+		if (node == from)
+			continue;
+		bool addressed = address == addresses[node] || (address == UART_BROADCAST_ADDRESS && node == BROADCAST_NODE);
+		if (!Expect(node, address, addressed))
+			return false;
+		if (!addressed && Sim_IRQStats(rxTxIRQs[node])->calls != 0)
+		{
+			printf("FAIL: node %u took %u interrupts for a message to %02X\n", node, Sim_IRQStats(rxTxIRQs[node])->calls, address);
+			return false;
+		}
+	}
+	return true;
+}
+
+// A 9 bit word without parity or the address mark would need a ninth data bit the driver can not carry,
+// and the address mark can not share the ninth bit with parity or go out through the eDMA
+static bool RejectConfigurations(void)
+{
+	UART_Config config = {};
+	config.skipPinSetup = true;
+	config.uartNum = 4;
+	config.mode = UART_TRANSCEIVER;
+	config.baudRate = BAUD_RATE;
+
+	config.extendedDataBits = true;
+	if (UART_Init(&config) != -1)
+	{
+		printf("FAIL: extendedDataBits without parity was accepted\n");
+		return false;
+	}
+
+	config.extendedDataBits = false;
+	config.multidrop = true;
+	config.parityEnable = true;
+	if (UART_Init(&config) != -1)
+	{
+		printf("FAIL: multidrop with parity was accepted\n");
+		return false;
+	}
+
+	config.parityEnable = false;
+	config.useDmaTx = true;
+	if (UART_Init(&config) != -1)
+	{
+		printf("FAIL: multidrop with the eDMA transmitter was accepted\n");
+		return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	Sim_Reset();
+	if (!RejectConfigurations())
+		return 1;
+
+	for (uint8_t node = 0; node < NODES; node++)
+	{
+		handles[node] = Open(node, addresses[node], node == BROADCAST_NODE);
+		if (handles[node] < 0)
+		{
+			printf("FAIL: node %u did not open\n", node);
+			return 1;
+		}
+		for (uint8_t other = 0; other < NODES; other++)
+		{
+			if (other != node)
+				Sim_Connect(node, other);
+		}
+	}
+
+	// The master polls every station, each one answers, and a broadcast goes out every round
+	uint32_t messages[NODES] = { 0 };
+	for (uint8_t round = 0; round < ROUNDS; round++)
+	{
+		for (uint8_t station = 1; station < NODES; station++)
+		{
+			if (!Send(MASTER, addresses[station], round) || !Send(station, MASTER_ADDRESS, round))
+				return 1;
+			messages[station]++;
+			messages[MASTER]++;
+		}
+		if (!Send(MASTER, UART_BROADCAST_ADDRESS, round))
+			return 1;
+		messages[BROADCAST_NODE]++;
+	}
+
+	// A station that changes its address stops hearing the old one
+	UART_SetAddress(handles[1], 4);
+	addresses[1] = 4;
+	if (!Send(MASTER, 1, 0) || !Send(MASTER, 4, 0))
+		return 1;
+	messages[1]++;
+
+	for (uint8_t node = 0; node < NODES; node++)
+	{
+		UART_Stats stats;
+		UART_GetStats(handles[node], &stats);
+		if (stats.bytesReceived != messages[node] * (MESSAGE_SIZE + 1) || stats.overruns != 0)
+		{
+			printf("FAIL: node %u counted %u bytes received and %u overruns, expected %u bytes\n",
+					node, stats.bytesReceived, stats.overruns, messages[node] * (MESSAGE_SIZE + 1));
+			return 1;
+		}
+		UART_Delete(handles[node]);
+	}
+
+	if (Sim_Storms() != 0)
+	{
+		printf("FAIL: %u interrupt storms\n", Sim_Storms());
+		return 1;
+	}
+
+	printf("PASS: %u addressed messages on a 4 node bus, none reached a station it was not meant for\n",
+			messages[0] + messages[1] + messages[2] + messages[3]);
+	return 0;
+}
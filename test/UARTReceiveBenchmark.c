@@ -0,0 +1,189 @@
+/***************************************************************************//**
+  @file     UARTReceiveBenchmark.c
+  @brief    Interrupts taken per received frame by the UART receive modes, on the simulated K64
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include "hardware.h"
+#include "UART.h"
+#include <stdio.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define BAUD_RATE		115200u
+#define FRAMES			200u
+#define FRAME_SIZE		64u
+#define GAP_CHARACTERS	4u		// Idle line between frames
+
+/*******************************************************************************
+ *                                OBJETOS
+ ******************************************************************************/
+
+typedef struct
+{
+	const char* pName;
+	uint8_t rxWatermark;
+	bool rxIdleTimeout;
+	bool useDmaRx;
+} ReceiveMode;
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+UART_DEFINE_INSTANCE(benchmarkBuffers, 1024, 64);
+
+static const ReceiveMode modes[] = {
+	{ "RX interrupt per byte", 1, false, false },
+	{ "RX watermark 6 + idle", 6, true, false },
+	{ "eDMA + idle frames", 1, false, true },
+};
+
+// UART0 has an 8 byte fifo, UART2 a single data register
+static const uint8_t uartNums[] = { 0, 2 };
+
+static uint8_t frame[FRAME_SIZE];
+static uint8_t received[1024];
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static uint8_t PatternByte(uint32_t index)
+{
+	return (uint8_t)(index * 13 + (index >> 6));
+}
+
+static void DriverInterrupts(uint32_t* pCalls, uint64_t* pCycles)
+{
+	*pCalls = 0;
+	*pCycles = 0;
+	for (int irq = DMA0_IRQn; irq <= UART5_ERR_IRQn; irq++)
+	{
+		*pCalls += Sim_IRQStats(irq)->calls;
+		*pCycles += Sim_IRQStats(irq)->hostCycles;
+	}
+}
+
+// Reads what the mode delivered and checks it against the pattern, frames come whole in eDMA mode.
+// Returns the bytes read, -1 if they are not the ones fed
+static int32_t Drain(UART_Handle handle, const ReceiveMode* pMode, uint32_t* pReceived, uint32_t* pFrames)
+{
+	uint16_t size = 0;
+	if (pMode->useDmaRx)
+	{
+		UART_FrameInfo info;
+		if (!UART_GetFrame(handle, received, sizeof(received), &info))
+			return 0;
+		size = info.size;
+		(*pFrames)++;
+	}
+	else
+	{
+		bool err = false;
+		if (!UART_GetData(handle, received, &size, &err))
+			return 0;
+	}
+
+	for (uint16_t i = 0; i < size; i++)
+	{
+		if (received[i] != PatternByte(*pReceived + i))
+		{
+			printf("FAIL: byte %u is %02X, expected %02X\n", *pReceived + i, received[i], PatternByte(*pReceived + i));
+			return -1;
+		}
+	}
+	*pReceived += size;
+	return size;
+}
+
+static bool Run(uint8_t uartNum, const ReceiveMode* pMode)
+{
+	UART_Config config = {};
+	config.skipPinSetup = true;
+	config.uartNum = uartNum;
+	config.mode = UART_RECEIVER;
+	config.baudRate = BAUD_RATE;
+	config.rxWatermark = pMode->rxWatermark;
+	config.rxIdleTimeout = pMode->rxIdleTimeout;
+	config.useDmaRx = pMode->useDmaRx;
+	UART_USE_INSTANCE(config, benchmarkBuffers);
+	UART_Handle handle = UART_Init(&config);
+	if (handle < 0)
+	{
+		printf("FAIL: UART%u did not open\n", uartNum);
+		return false;
+	}
+
+	Sim_ResetIRQStats();
+	uint32_t charCycles = Sim_CharCycles(uartNum);
+	uint32_t receivedBytes = 0, frames = 0;
+	for (uint32_t f = 0; f < FRAMES; f++)
+	{
+		for (uint32_t i = 0; i < FRAME_SIZE; i++)
+		{
+			frame[i] = PatternByte(f * FRAME_SIZE + i);
+		}
+		Sim_Feed(uartNum, frame, FRAME_SIZE);
+		Sim_Run((uint64_t)charCycles * (FRAME_SIZE + GAP_CHARACTERS));
+
+		int32_t size;
+		while ((size = Drain(handle, pMode, &receivedBytes, &frames)) > 0)
+		{
+		}
+		if (size < 0)
+			return false;
+	}
+
+	uint32_t calls;
+	uint64_t cycles;
+	DriverInterrupts(&calls, &cycles);
+	UART_Delete(handle);
+
+	if (receivedBytes != FRAMES * FRAME_SIZE)
+	{
+		printf("FAIL: UART%u %s received %u bytes, expected %u\n", uartNum, pMode->pName, receivedBytes, FRAMES * FRAME_SIZE);
+		return false;
+	}
+	if (pMode->useDmaRx && frames != FRAMES)
+	{
+		printf("FAIL: UART%u delivered %u idle frames, expected %u\n", uartNum, frames, FRAMES);
+		return false;
+	}
+
+	printf("UART%u %-22s: %6u interrupts, %6.2f per frame, %5.3f per byte, %6.1f host cycles per byte\n",
+			uartNum, pMode->pName, calls, (double)calls / FRAMES, (double)calls / (FRAMES * FRAME_SIZE),
+			(double)cycles / (FRAMES * FRAME_SIZE));
+	return true;
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+int main(void)
+{
+	Sim_Reset();
+	printf("%u frames of %u bytes at %u baud, %u idle characters apart\n", FRAMES, FRAME_SIZE, BAUD_RATE, GAP_CHARACTERS);
+
+	for (uint8_t u = 0; u < sizeof(uartNums); u++)
+	{
+		for (uint8_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+		{
+			if (!Run(uartNums[u], &modes[m]))
+				return 1;
+		}
+	}
+
+	if (Sim_Storms() != 0)
+	{
+		printf("FAIL: %u interrupt storms\n", Sim_Storms());
+		return 1;
+	}
+	return 0;
+}
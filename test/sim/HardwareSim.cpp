@@ -0,0 +1,1148 @@
+/***************************************************************************//**
+  @file     HardwareSim.cpp
+  @brief    Host model of the K64 UART, eDMA, PIT, SysTick and NVIC the drivers run against in the tests
+  @author   Group 2
+ ******************************************************************************/
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+// Ahead of the device header, whose __I and __O macros clash with the intrinsics' parameter names
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+#include <string.h>
+#include <time.h>
+#include "hardware.h"
+#include "gpio.h"
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define IRQ_SLOTS		128
+#define DMA_CHANNELS	16
+#define NEVER			UINT64_MAX
+
+// UART0 and UART1 have 8 word fifos, the rest a single data register
+#define FIFO_DEPTH(n)	((n) < 2 ? 8u : 1u)
+
+// Latched status flags, cleared by reading S1 then D
+#define LATCHED_FLAGS	(UART_S1_IDLE_MASK | UART_S1_OR_MASK | UART_S1_NF_MASK | UART_S1_FE_MASK | UART_S1_PF_MASK)
+
+/*******************************************************************************
+ *                                OBJETOS
+ ******************************************************************************/
+
+typedef struct
+{
+	uint16_t rxFifo[8];
+	uint8_t rxHead;
+	uint8_t rxCount;
+	uint16_t txFifo[8];
+	uint8_t txHead;
+	uint8_t txCount;
+
+	bool shifting;				// A character is on the wire
+	uint16_t shiftWord;
+	uint64_t shiftEnd;
+
+	uint8_t flags;				// LATCHED_FLAGS set
+	uint8_t armed;				// Flags seen by an S1 read, the next D read clears them
+	uint8_t sfifo;
+	bool addressMatched;		// Multidrop, data after a matching address is received
+
+	bool idleArmed;				// A character came in since the last idle line
+	uint64_t idleAt;
+
+	uint32_t sinks;				// Receivers driven by the transmitter, one bit per module
+
+	uint16_t feed[SIM_FEED_SIZE];
+	uint32_t feedHead;
+	uint32_t feedTail;
+	bool feeding;
+	bool feedStalled;			// Waiting for RTS
+	uint64_t feedAt;
+
+	uint16_t capture[SIM_CAPTURE_SIZE];
+	uint32_t captured;
+} SimUARTState;
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+UART_Type simUART[SIM_UART_COUNT];
+DMA_Type simDMA;
+DMAMUX_Type simDMAMUX;
+PIT_Type simPIT;
+SIM_Type simSIM;
+SimSysTick_Type simSysTick;
+SimSCB_Type simSCB;
+SimDWT_Type simDWT;
+CoreDebug_Type simCoreDebug;
+
+static SimUARTState uarts[SIM_UART_COUNT];
+static uint64_t now;
+
+static bool nvicEnabled[IRQ_SLOTS];
+static uint32_t primask;
+static bool inHandler;
+static bool servicing;
+
+static void (*handlers[IRQ_SLOTS + 1])(void);
+static SimIRQStats irqStats[IRQ_SLOTS + 1];
+static uint32_t callsSinceAdvance[IRQ_SLOTS + 1];
+static bool stormed[IRQ_SLOTS + 1];
+static uint32_t storms;
+
+static uint32_t dmaPendingErrors;
+
+static bool sysTickEnabled;
+static bool sysTickPending;
+static uint64_t sysTickStart;
+static uint64_t sysTickReload;
+
+static bool pitEnabled[4];
+static uint32_t pitFlags[4];
+static uint64_t pitStart[4];
+static uint64_t pitExpiry[4];
+
+static const IRQn_Type rxTxIRQs[SIM_UART_COUNT] = UART_RX_TX_IRQS;
+static const IRQn_Type errIRQs[SIM_UART_COUNT] = UART_ERR_IRQS;
+
+/*******************************************************************************
+ *                          HANDLERS DE LOS DRIVERS
+ ******************************************************************************/
+
+// Only the drivers linked into the test provide them
+void SysTick_Handler(void) __attribute__((weak));
+void DMA0_IRQHandler(void) __attribute__((weak));
+void DMA1_IRQHandler(void) __attribute__((weak));
+void DMA2_IRQHandler(void) __attribute__((weak));
+void DMA3_IRQHandler(void) __attribute__((weak));
+void DMA4_IRQHandler(void) __attribute__((weak));
+void DMA5_IRQHandler(void) __attribute__((weak));
+void DMA6_IRQHandler(void) __attribute__((weak));
+void DMA7_IRQHandler(void) __attribute__((weak));
+void DMA8_IRQHandler(void) __attribute__((weak));
+void DMA9_IRQHandler(void) __attribute__((weak));
+void DMA10_IRQHandler(void) __attribute__((weak));
+void DMA11_IRQHandler(void) __attribute__((weak));
+void DMA12_IRQHandler(void) __attribute__((weak));
+void DMA13_IRQHandler(void) __attribute__((weak));
+void DMA14_IRQHandler(void) __attribute__((weak));
+void DMA15_IRQHandler(void) __attribute__((weak));
+void DMA_Error_IRQHandler(void) __attribute__((weak));
+void PIT0_IRQHandler(void) __attribute__((weak));
+void PIT1_IRQHandler(void) __attribute__((weak));
+void PIT2_IRQHandler(void) __attribute__((weak));
+void PIT3_IRQHandler(void) __attribute__((weak));
+void UART0_RX_TX_IRQHandler(void) __attribute__((weak));
+void UART0_ERR_IRQHandler(void) __attribute__((weak));
+void UART1_RX_TX_IRQHandler(void) __attribute__((weak));
+void UART1_ERR_IRQHandler(void) __attribute__((weak));
+void UART2_RX_TX_IRQHandler(void) __attribute__((weak));
+void UART2_ERR_IRQHandler(void) __attribute__((weak));
+void UART3_RX_TX_IRQHandler(void) __attribute__((weak));
+void UART3_ERR_IRQHandler(void) __attribute__((weak));
+void UART4_RX_TX_IRQHandler(void) __attribute__((weak));
+void UART4_ERR_IRQHandler(void) __attribute__((weak));
+void UART5_RX_TX_IRQHandler(void) __attribute__((weak));
+void UART5_ERR_IRQHandler(void) __attribute__((weak));
+
+/*******************************************************************************
+ *                           FUNCIONES LOCALES
+ ******************************************************************************/
+
+static void Service(void);
+
+// Core cycles per bus cycle, as set by the clock dividers
+static uint64_t BusToCore(uint64_t busCycles)
+{
+	uint32_t outdiv1 = (simSIM.CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT;
+	uint32_t outdiv2 = (simSIM.CLKDIV1 & SIM_CLKDIV1_OUTDIV2_MASK) >> SIM_CLKDIV1_OUTDIV2_SHIFT;
+	return busCycles * (outdiv2 + 1) / (outdiv1 + 1);
+}
+
+static uint64_t CoreToBus(uint64_t coreCycles)
+{
+	uint32_t outdiv1 = (simSIM.CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT;
+	uint32_t outdiv2 = (simSIM.CLKDIV1 & SIM_CLKDIV1_OUTDIV2_MASK) >> SIM_CLKDIV1_OUTDIV2_SHIFT;
+	return coreCycles * (outdiv1 + 1) / (outdiv2 + 1);
+}
+
+/*******************************************************************************
+ *                                 UART
+ ******************************************************************************/
+
+static uint8_t RxWatermark(uint8_t n)
+{
+	uint8_t watermark = simUART[n].RWFIFO.value;
+	return watermark ? watermark : 1;
+}
+
+static bool Tdre(uint8_t n)
+{
+	return uarts[n].txCount <= simUART[n].TWFIFO.value;
+}
+
+static bool Tc(uint8_t n)
+{
+	return uarts[n].txCount == 0 && !uarts[n].shifting;
+}
+
+static bool Rdrf(uint8_t n)
+{
+	return uarts[n].rxCount >= RxWatermark(n);
+}
+
+// RXRTSE deasserts RTS once the fifo reaches the receive watermark
+static bool RtsAsserted(uint8_t n)
+{
+	return !(simUART[n].MODEM.value & UART_MODEM_RXRTSE_MASK) || uarts[n].rxCount < RxWatermark(n);
+}
+
+static uint32_t Sinks(uint8_t n)
+{
+	return (simUART[n].C1.value & UART_C1_LOOPS_MASK) ? 1u << n : uarts[n].sinks;
+}
+
+// CTS comes from the RTS of the first receiver on the line
+static bool CtsAsserted(uint8_t n)
+{
+	if (!(simUART[n].MODEM.value & UART_MODEM_TXCTSE_MASK))
+		return true;
+	uint32_t sinks = Sinks(n);
+	for (uint8_t m = 0; m < SIM_UART_COUNT; m++)
+	{
+		if (sinks & (1u << m))
+			return RtsAsserted(m);
+	}
+	return true;
+}
+
+static bool TxDmaRequest(uint8_t n)
+{
+	return (simUART[n].C5.value & UART_C5_TDMAS_MASK) && (simUART[n].C2.value & UART_C2_TIE_MASK) && Tdre(n);
+}
+
+static bool RxDmaRequest(uint8_t n)
+{
+	return (simUART[n].C5.value & UART_C5_RDMAS_MASK) && (simUART[n].C2.value & UART_C2_RIE_MASK) && Rdrf(n);
+}
+
+static bool RxTxInterrupt(uint8_t n)
+{
+	uint8_t c2 = simUART[n].C2.value;
+	uint8_t c5 = simUART[n].C5.value;
+	return ((c2 & UART_C2_TIE_MASK) && !(c5 & UART_C5_TDMAS_MASK) && Tdre(n)) ||
+			((c2 & UART_C2_TCIE_MASK) && Tc(n)) ||
+			((c2 & UART_C2_RIE_MASK) && !(c5 & UART_C5_RDMAS_MASK) && Rdrf(n)) ||
+			((c2 & UART_C2_ILIE_MASK) && (uarts[n].flags & UART_S1_IDLE_MASK));
+}
+
+static bool ErrInterrupt(uint8_t n)
+{
+	uint8_t c3 = simUART[n].C3.value;
+	uint8_t flags = uarts[n].flags;
+	return ((c3 & UART_C3_ORIE_MASK) && (flags & UART_S1_OR_MASK)) || ((c3 & UART_C3_NEIE_MASK) && (flags & UART_S1_NF_MASK)) ||
+			((c3 & UART_C3_FEIE_MASK) && (flags & UART_S1_FE_MASK)) || ((c3 & UART_C3_PEIE_MASK) && (flags & UART_S1_PF_MASK));
+}
+
+// A character starts on the line, the receivers are no longer idle
+static void LineBusy(uint32_t receivers)
+{
+	for (uint8_t m = 0; m < SIM_UART_COUNT; m++)
+	{
+		if ((receivers & (1u << m)) && uarts[m].idleArmed)
+			uarts[m].idleAt = NEVER;
+	}
+}
+
+static void Receive(uint8_t n, uint16_t word)
+{
+	UART_Type* pUCR = &simUART[n];
+	SimUARTState* pState = &uarts[n];
+	if (!(pUCR->C2.value & UART_C2_RE_MASK))
+		return;
+
+	// The line went idle one character after this one, unless another one starts
+	pState->idleArmed = true;
+	pState->idleAt = now + Sim_CharCycles(n);
+
+	// Address match: an address for this station is received and opens the data after it, any other closes it
+	bool nineBits = pUCR->C1.value & UART_C1_M_MASK;
+	uint8_t c4 = pUCR->C4.value;
+	if (nineBits && (c4 & (UART_C4_MAEN1_MASK | UART_C4_MAEN2_MASK)))
+	{
+		if (word & 0x100)
+		{
+			uint8_t address = (uint8_t)word;
+			pState->addressMatched = ((c4 & UART_C4_MAEN1_MASK) && address == pUCR->MA1.value) ||
+					((c4 & UART_C4_MAEN2_MASK) && address == pUCR->MA2.value);
+		}
+		if (!pState->addressMatched)
+			return;
+	}
+
+	// Nothing else is stored until the overrun is cleared
+	if (pState->flags & UART_S1_OR_MASK)
+		return;
+	if (pState->rxCount == FIFO_DEPTH(n))
+	{
+		pState->flags |= UART_S1_OR_MASK;
+		return;
+	}
+
+	pState->rxFifo[(pState->rxHead + pState->rxCount) % FIFO_DEPTH(n)] = word;
+	pState->rxCount++;
+}
+
+static uint8_t ReadS1(uint8_t n)
+{
+	SimUARTState* pState = &uarts[n];
+	pState->armed |= pState->flags & LATCHED_FLAGS;
+
+	uint8_t s1 = pState->flags;
+	if (Tdre(n))
+		s1 |= UART_S1_TDRE_MASK;
+	if (Tc(n))
+		s1 |= UART_S1_TC_MASK;
+	if (Rdrf(n))
+		s1 |= UART_S1_RDRF_MASK;
+	return s1;
+}
+
+static uint8_t ReadD(uint8_t n)
+{
+	SimUARTState* pState = &uarts[n];
+	pState->flags &= ~pState->armed;
+	pState->armed = 0;
+
+	uint8_t data = 0;
+	if (pState->rxCount == 0)
+	{
+		pState->sfifo |= UART_SFIFO_RXUF_MASK;
+	}
+	else
+	{
+		data = (uint8_t)pState->rxFifo[pState->rxHead];
+		pState->rxHead = (pState->rxHead + 1) % FIFO_DEPTH(n);
+		pState->rxCount--;
+	}
+
+	// Room in the fifo may assert RTS again
+	Service();
+	return data;
+}
+
+static void WriteD(uint8_t n, uint8_t data)
+{
+	SimUARTState* pState = &uarts[n];
+	if (pState->txCount == FIFO_DEPTH(n))
+	{
+		pState->sfifo |= UART_SFIFO_TXOF_MASK;
+		return;
+	}
+
+	// T8 is latched with the write
+	uint16_t word = data | ((simUART[n].C3.value & UART_C3_T8_MASK) ? 0x100 : 0);
+	pState->txFifo[(pState->txHead + pState->txCount) % FIFO_DEPTH(n)] = word;
+	pState->txCount++;
+	Service();
+}
+
+static void WriteCFIFO(uint8_t n, uint8_t value)
+{
+	SimUARTState* pState = &uarts[n];
+	if (value & UART_CFIFO_RXFLUSH_MASK)
+		pState->rxCount = 0;
+	if (value & UART_CFIFO_TXFLUSH_MASK)
+		pState->txCount = 0;
+	simUART[n].CFIFO.value = value & ~(UART_CFIFO_RXFLUSH_MASK | UART_CFIFO_TXFLUSH_MASK);
+	Service();
+}
+
+static uint8_t ReadSFIFO(uint8_t n)
+{
+	return uarts[n].sfifo;
+}
+
+static void WriteSFIFO(uint8_t n, uint8_t value)
+{
+	uarts[n].sfifo &= ~(value & (UART_SFIFO_RXUF_MASK | UART_SFIFO_TXOF_MASK | UART_SFIFO_RXOF_MASK));
+}
+
+static uint8_t ReadRCFIFO(uint8_t n)
+{
+	return uarts[n].rxCount;
+}
+
+static uint8_t ReadTCFIFO(uint8_t n)
+{
+	return uarts[n].txCount;
+}
+
+static uint8_t ReadED(uint8_t n)
+{
+	(void)n;
+	return 0;
+}
+
+// Control registers, any change may raise a request or start the transmitter
+static void WriteControl(uint8_t n, uint8_t value)
+{
+	(void)n;
+	(void)value;
+	Service();
+}
+
+// Moves the next character from the fifo to the shift register of every idle transmitter
+static bool StartTransmitters(void)
+{
+	bool started = false;
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		SimUARTState* pState = &uarts[n];
+		if (pState->shifting || pState->txCount == 0 || !(simUART[n].C2.value & UART_C2_TE_MASK) || !CtsAsserted(n))
+			continue;
+
+		pState->shiftWord = pState->txFifo[pState->txHead];
+		pState->txHead = (pState->txHead + 1) % FIFO_DEPTH(n);
+		pState->txCount--;
+		pState->shifting = true;
+		pState->shiftEnd = now + Sim_CharCycles(n);
+		LineBusy(Sinks(n));
+		started = true;
+	}
+	return started;
+}
+
+/*******************************************************************************
+ *                                 eDMA
+ ******************************************************************************/
+
+static bool DmaRequest(uint8_t source)
+{
+	if (source >= 2 && source <= 9)
+		return source % 2 == 0 ? RxDmaRequest((source - 2) / 2) : TxDmaRequest((source - 2) / 2);
+	// UART4 and UART5 share one source for both directions
+	if (source == 10 || source == 11)
+		return RxDmaRequest(source - 6) || TxDmaRequest(source - 6);
+	return false;
+}
+
+static SimReg8* RegisterAt(uint32_t address)
+{
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		if (address == (uint32_t)(uintptr_t)&simUART[n].D)
+			return &simUART[n].D;
+	}
+	return 0;
+}
+
+// Addresses are 32 bit, the tests link without PIE so their static buffers are below 4 GB
+static uint8_t DmaRead(uint32_t address)
+{
+	SimReg8* pRegister = RegisterAt(address);
+	return pRegister ? (uint8_t)*pRegister : *(uint8_t*)(uintptr_t)address;
+}
+
+static void DmaWrite(uint32_t address, uint8_t data)
+{
+	SimReg8* pRegister = RegisterAt(address);
+	if (pRegister)
+		*pRegister = data;
+	else
+		*(uint8_t*)(uintptr_t)address = data;
+}
+
+static void MinorLoop(uint8_t ch)
+{
+	SimTCD* pTCD = &simDMA.TCD[ch];
+	uint32_t bit = 1u << ch;
+
+	// The failed access stops the channel, nothing of this minor loop is moved
+	if (dmaPendingErrors & bit)
+	{
+		dmaPendingErrors &= ~bit;
+		simDMA.ERR |= bit;
+		simDMA.ES = DMA_ES_VLD_MASK | DMA_ES_SBE_MASK | DMA_ES_ERRCHN(ch);
+		simDMA.ERQ &= ~bit;
+		if (simDMA.CR & DMA_CR_HOE_MASK)
+			simDMA.CR |= DMA_CR_HALT_MASK;
+		return;
+	}
+
+	for (uint32_t i = 0; i < pTCD->NBYTES_MLNO; i++)
+	{
+		DmaWrite(pTCD->DADDR, DmaRead(pTCD->SADDR));
+		pTCD->SADDR += (int16_t)pTCD->SOFF;
+		pTCD->DADDR += (int16_t)pTCD->DOFF;
+	}
+
+	pTCD->CITER_ELINKNO--;
+	if (pTCD->CITER_ELINKNO == 0)
+	{
+		pTCD->SADDR += pTCD->SLAST;
+		pTCD->DADDR += pTCD->DLAST_SGA;
+		pTCD->CITER_ELINKNO = pTCD->BITER_ELINKNO;
+		pTCD->CSR |= DMA_CSR_DONE_MASK;
+		if (pTCD->CSR & DMA_CSR_INTMAJOR_MASK)
+			simDMA.INT |= bit;
+		if (pTCD->CSR & DMA_CSR_DREQ_MASK)
+			simDMA.ERQ &= ~bit;
+	}
+	else if ((pTCD->CSR & DMA_CSR_INTHALF_MASK) && pTCD->CITER_ELINKNO == pTCD->BITER_ELINKNO / 2)
+	{
+		simDMA.INT |= bit;
+	}
+}
+
+// Serves the requests one minor loop at a time, lowest channel first like the fixed priority arbitration
+static bool ServiceDMA(void)
+{
+	bool served = false;
+	while (!(simDMA.CR & DMA_CR_HALT_MASK))
+	{
+		int8_t channel = -1;
+		for (uint8_t ch = 0; ch < DMA_CHANNELS && channel < 0; ch++)
+		{
+			uint8_t chcfg = simDMAMUX.CHCFG[ch];
+			if ((simDMA.ERQ & (1u << ch)) && (chcfg & DMAMUX_CHCFG_ENBL_MASK) && DmaRequest(chcfg & DMAMUX_CHCFG_SOURCE_MASK))
+				channel = ch;
+		}
+		if (channel < 0)
+			break;
+
+		MinorLoop(channel);
+		served = true;
+	}
+	return served;
+}
+
+// Command registers, the channel number or all of them with the top bit
+static uint32_t Channels(uint8_t value)
+{
+	return (value & 0x40) ? 0xFFFFu : 1u << (value & 0x0F);
+}
+
+static void WriteCEEI(uint8_t owner, uint8_t value) { (void)owner; simDMA.EEI &= ~Channels(value); }
+static void WriteSEEI(uint8_t owner, uint8_t value) { (void)owner; simDMA.EEI |= Channels(value); Service(); }
+static void WriteCERQ(uint8_t owner, uint8_t value) { (void)owner; simDMA.ERQ &= ~Channels(value); }
+static void WriteSERQ(uint8_t owner, uint8_t value) { (void)owner; simDMA.ERQ |= Channels(value); Service(); }
+static void WriteCERR(uint8_t owner, uint8_t value) { (void)owner; simDMA.ERR &= ~Channels(value); }
+static void WriteCINT(uint8_t owner, uint8_t value) { (void)owner; simDMA.INT &= ~Channels(value); }
+
+static void WriteCDNE(uint8_t owner, uint8_t value)
+{
+	(void)owner;
+	uint32_t channels = Channels(value);
+	for (uint8_t ch = 0; ch < DMA_CHANNELS; ch++)
+	{
+		if (channels & (1u << ch))
+			simDMA.TCD[ch].CSR &= ~DMA_CSR_DONE_MASK;
+	}
+}
+
+/*******************************************************************************
+ *                             PIT Y SYSTICK
+ ******************************************************************************/
+
+static uint64_t PitPeriod(uint8_t channel)
+{
+	return BusToCore((uint64_t)simPIT.CHANNEL[channel].LDVAL + 1);
+}
+
+// Times the channel reached zero since it was enabled
+static uint64_t PitExpirations(uint8_t channel, uint64_t at)
+{
+	return CoreToBus(at - pitStart[channel]) / ((uint64_t)simPIT.CHANNEL[channel].LDVAL + 1);
+}
+
+static uint32_t ReadCVAL(uint8_t channel)
+{
+	uint64_t period = (uint64_t)simPIT.CHANNEL[channel].LDVAL + 1;
+	if (!pitEnabled[channel])
+		return simPIT.CHANNEL[channel].LDVAL;
+
+	// A chained channel counts the expirations of the one before it
+	uint64_t counted;
+	if ((simPIT.CHANNEL[channel].TCTRL.value & PIT_TCTRL_CHN_MASK) && channel > 0)
+		counted = PitExpirations(channel - 1, now) - PitExpirations(channel - 1, pitStart[channel]);
+	else
+		counted = CoreToBus(now - pitStart[channel]);
+	return (uint32_t)(simPIT.CHANNEL[channel].LDVAL - counted % period);
+}
+
+static void WriteTCTRL(uint8_t channel, uint32_t value)
+{
+	bool enable = value & PIT_TCTRL_TEN_MASK;
+	if (enable && !pitEnabled[channel])
+	{
+		pitStart[channel] = now;
+		pitExpiry[channel] = (value & PIT_TCTRL_CHN_MASK) ? NEVER : now + PitPeriod(channel);
+	}
+	else if (!enable)
+	{
+		pitExpiry[channel] = NEVER;
+	}
+	pitEnabled[channel] = enable;
+	Service();
+}
+
+// Write one to clear
+static void WriteTFLG(uint8_t channel, uint32_t value)
+{
+	pitFlags[channel] &= ~(value & PIT_TFLG_TIF_MASK);
+}
+
+static uint32_t ReadTFLG(uint8_t channel)
+{
+	return pitFlags[channel];
+}
+
+static void RestartSysTick(void)
+{
+	sysTickStart = now;
+	sysTickReload = sysTickEnabled ? now + simSysTick.LOAD.value + 1 : NEVER;
+}
+
+static void WriteSysTickCTRL(uint8_t owner, uint32_t value)
+{
+	(void)owner;
+	bool enable = value & SysTick_CTRL_ENABLE_Msk;
+	if (enable != sysTickEnabled)
+	{
+		sysTickEnabled = enable;
+		RestartSysTick();
+	}
+}
+
+// Writing VAL clears it, the count restarts from LOAD
+static void WriteSysTickVAL(uint8_t owner, uint32_t value)
+{
+	(void)owner;
+	(void)value;
+	RestartSysTick();
+}
+
+static uint32_t ReadSysTickVAL(uint8_t owner)
+{
+	(void)owner;
+	if (!sysTickEnabled)
+		return 0;
+	uint64_t period = (uint64_t)simSysTick.LOAD.value + 1;
+	return (uint32_t)(simSysTick.LOAD.value - (now - sysTickStart) % period);
+}
+
+static uint32_t ReadICSR(uint8_t owner)
+{
+	(void)owner;
+	return sysTickPending ? SCB_ICSR_PENDSTSET_Msk : 0;
+}
+
+static uint32_t ReadCYCCNT(uint8_t owner)
+{
+	(void)owner;
+	return (uint32_t)now;
+}
+
+/*******************************************************************************
+ *                                 NVIC
+ ******************************************************************************/
+
+static bool Pending(int irq)
+{
+	if (irq == SysTick_IRQn)
+		return sysTickPending;
+	if (!nvicEnabled[irq])
+		return false;
+	if (irq < DMA_CHANNELS)
+		return simDMA.INT & (1u << irq);
+	if (irq == DMA_Error_IRQn)
+		return simDMA.ERR & simDMA.EEI;
+	if (irq >= PIT0_IRQn && irq <= PIT3_IRQn)
+	{
+		uint8_t channel = irq - PIT0_IRQn;
+		return (pitFlags[channel] & PIT_TFLG_TIF_MASK) && (simPIT.CHANNEL[channel].TCTRL.value & PIT_TCTRL_TIE_MASK);
+	}
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		if (irq == rxTxIRQs[n])
+			return RxTxInterrupt(n);
+		if (irq == errIRQs[n])
+			return ErrInterrupt(n);
+	}
+	return false;
+}
+
+// Calls the handler of the lowest pending interrupt. Handlers do not nest
+static bool DispatchOne(void)
+{
+	for (int irq = SysTick_IRQn; irq < IRQ_SLOTS; irq++)
+	{
+		int slot = irq + 1;
+		if (handlers[slot] == 0 || stormed[slot] || !Pending(irq))
+			continue;
+
+		if (++callsSinceAdvance[slot] > SIM_STORM_LIMIT)
+		{
+			stormed[slot] = true;
+			storms++;
+			continue;
+		}
+
+		if (irq == SysTick_IRQn)
+			sysTickPending = false;
+
+		inHandler = true;
+		uint64_t start = Sim_HostCycles();
+		handlers[slot]();
+		irqStats[slot].hostCycles += Sim_HostCycles() - start;
+		irqStats[slot].calls++;
+		inHandler = false;
+		return true;
+	}
+	return false;
+}
+
+// Runs everything the current state triggers: transmitters, eDMA requests and, unless masked, the interrupts
+static void Service(void)
+{
+	if (servicing)
+		return;
+	servicing = true;
+
+	bool progress;
+	do
+	{
+		progress = StartTransmitters();
+		progress |= ServiceDMA();
+		if (primask == 0 && !inHandler)
+			progress |= DispatchOne();
+	} while (progress);
+
+	servicing = false;
+}
+
+/*******************************************************************************
+ *                                TIEMPO
+ ******************************************************************************/
+
+static uint64_t NextEvent(void)
+{
+	uint64_t next = NEVER;
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		SimUARTState* pState = &uarts[n];
+		if (pState->shifting && pState->shiftEnd < next)
+			next = pState->shiftEnd;
+		if (pState->feeding && pState->feedAt < next)
+			next = pState->feedAt;
+		if (pState->idleArmed && pState->idleAt < next)
+			next = pState->idleAt;
+	}
+	if (sysTickReload < next)
+		next = sysTickReload;
+	for (uint8_t ch = 0; ch < 4; ch++)
+	{
+		if (pitExpiry[ch] < next)
+			next = pitExpiry[ch];
+	}
+	return next;
+}
+
+static void AdvanceTo(uint64_t time)
+{
+	if (time == now)
+		return;
+	now = time;
+	memset(callsSinceAdvance, 0, sizeof(callsSinceAdvance));
+	memset(stormed, 0, sizeof(stormed));
+}
+
+static void FeedEvent(uint8_t n)
+{
+	SimUARTState* pState = &uarts[n];
+	if (!pState->feedStalled)
+	{
+		uint16_t word = pState->feed[pState->feedTail % SIM_FEED_SIZE];
+		pState->feedTail++;
+		Receive(n, word);
+		if (pState->feedTail == pState->feedHead)
+		{
+			pState->feeding = false;
+			return;
+		}
+	}
+
+	// The sender checks CTS before starting each character, and polls it every bit while it is deasserted
+	pState->feedStalled = !RtsAsserted(n);
+	if (pState->feedStalled)
+	{
+		pState->feedAt = now + Sim_CharCycles(n) / 10 + 1;
+	}
+	else
+	{
+		pState->feedAt = now + Sim_CharCycles(n);
+		LineBusy(1u << n);
+	}
+}
+
+// Character ends first, a receiver that gets one at the same time as its idle deadline is not idle
+static void ProcessEvents(void)
+{
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		SimUARTState* pState = &uarts[n];
+		if (!pState->shifting || pState->shiftEnd > now)
+			continue;
+
+		pState->shifting = false;
+		if (pState->captured < SIM_CAPTURE_SIZE)
+			pState->capture[pState->captured++] = pState->shiftWord;
+		uint32_t sinks = Sinks(n);
+		for (uint8_t m = 0; m < SIM_UART_COUNT; m++)
+		{
+			if (sinks & (1u << m))
+				Receive(m, pState->shiftWord);
+		}
+	}
+
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		if (uarts[n].feeding && uarts[n].feedAt <= now)
+			FeedEvent(n);
+	}
+
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		SimUARTState* pState = &uarts[n];
+		if (pState->idleArmed && pState->idleAt <= now)
+		{
+			pState->flags |= UART_S1_IDLE_MASK;
+			pState->idleArmed = false;
+		}
+	}
+
+	if (sysTickReload <= now)
+	{
+		if (simSysTick.CTRL.value & SysTick_CTRL_TICKINT_Msk)
+			sysTickPending = true;
+		sysTickReload += (uint64_t)simSysTick.LOAD.value + 1;
+	}
+
+	for (uint8_t ch = 0; ch < 4; ch++)
+	{
+		if (pitExpiry[ch] <= now)
+		{
+			pitFlags[ch] |= PIT_TFLG_TIF_MASK;
+			pitExpiry[ch] += PitPeriod(ch);
+		}
+	}
+}
+
+static void InitRegister8(SimReg8* pRegister, uint8_t owner, uint8_t (*pRead)(uint8_t), void (*pWrite)(uint8_t, uint8_t), uint8_t value)
+{
+	pRegister->value = value;
+	pRegister->owner = owner;
+	pRegister->pRead = pRead;
+	pRegister->pWrite = pWrite;
+}
+
+static void InitRegister32(SimReg32* pRegister, uint8_t owner, uint32_t (*pRead)(uint8_t), void (*pWrite)(uint8_t, uint32_t))
+{
+	pRegister->value = 0;
+	pRegister->owner = owner;
+	pRegister->pRead = pRead;
+	pRegister->pWrite = pWrite;
+}
+
+static void ResetUART(uint8_t n)
+{
+	UART_Type* pUCR = &simUART[n];
+	SimReg8* controls[] = { &pUCR->BDH, &pUCR->C1, &pUCR->C2, &pUCR->S2, &pUCR->C3, &pUCR->MA1, &pUCR->MA2, &pUCR->C4,
+			&pUCR->C5, &pUCR->MODEM, &pUCR->IR, &pUCR->TWFIFO };
+	for (uint8_t i = 0; i < sizeof(controls) / sizeof(controls[0]); i++)
+	{
+		InitRegister8(controls[i], n, 0, &WriteControl, 0);
+	}
+	InitRegister8(&pUCR->BDL, n, 0, &WriteControl, 4);
+	InitRegister8(&pUCR->RWFIFO, n, 0, &WriteControl, 1);
+	InitRegister8(&pUCR->S1, n, &ReadS1, 0, 0);
+	InitRegister8(&pUCR->D, n, &ReadD, &WriteD, 0);
+	InitRegister8(&pUCR->ED, n, &ReadED, 0, 0);
+	// Fifo sizes: 8 words on UART0 and UART1, a single one on the rest
+	InitRegister8(&pUCR->PFIFO, n, 0, 0, n < 2 ? UART_PFIFO_TXFIFOSIZE(2) | UART_PFIFO_RXFIFOSIZE(2) : 0);
+	InitRegister8(&pUCR->CFIFO, n, 0, &WriteCFIFO, 0);
+	InitRegister8(&pUCR->SFIFO, n, &ReadSFIFO, &WriteSFIFO, 0);
+	InitRegister8(&pUCR->TCFIFO, n, &ReadTCFIFO, 0, 0);
+	InitRegister8(&pUCR->RCFIFO, n, &ReadRCFIFO, 0, 0);
+
+	memset(&uarts[n], 0, sizeof(SimUARTState));
+}
+
+/*******************************************************************************
+ *                           FUNCIONES GLOBALES
+ ******************************************************************************/
+
+void Sim_Reset(void)
+{
+	now = 0;
+	primask = 0;
+	inHandler = false;
+	servicing = false;
+	storms = 0;
+	memset(nvicEnabled, 0, sizeof(nvicEnabled));
+	Sim_ResetIRQStats();
+
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		ResetUART(n);
+	}
+
+	memset((void*)&simDMA, 0, sizeof(simDMA));
+	InitRegister8(&simDMA.CEEI, 0, 0, &WriteCEEI, 0);
+	InitRegister8(&simDMA.SEEI, 0, 0, &WriteSEEI, 0);
+	InitRegister8(&simDMA.CERQ, 0, 0, &WriteCERQ, 0);
+	InitRegister8(&simDMA.SERQ, 0, 0, &WriteSERQ, 0);
+	InitRegister8(&simDMA.CDNE, 0, 0, &WriteCDNE, 0);
+	InitRegister8(&simDMA.SSRT, 0, 0, 0, 0);
+	InitRegister8(&simDMA.CERR, 0, 0, &WriteCERR, 0);
+	InitRegister8(&simDMA.CINT, 0, 0, &WriteCINT, 0);
+	dmaPendingErrors = 0;
+	memset((void*)&simDMAMUX, 0, sizeof(simDMAMUX));
+
+	memset((void*)&simPIT, 0, sizeof(simPIT));
+	for (uint8_t ch = 0; ch < 4; ch++)
+	{
+		InitRegister32(&simPIT.CHANNEL[ch].CVAL, ch, &ReadCVAL, 0);
+		InitRegister32(&simPIT.CHANNEL[ch].TCTRL, ch, 0, &WriteTCTRL);
+		InitRegister32(&simPIT.CHANNEL[ch].TFLG, ch, &ReadTFLG, &WriteTFLG);
+		pitEnabled[ch] = false;
+		pitFlags[ch] = 0;
+		pitExpiry[ch] = NEVER;
+	}
+
+	memset((void*)&simSIM, 0, sizeof(simSIM));
+	simSIM.CLKDIV1 = SIM_CLKDIV1_OUTDIV1(0x00) | SIM_CLKDIV1_OUTDIV2(0x01) | SIM_CLKDIV1_OUTDIV3(0x01) | SIM_CLKDIV1_OUTDIV4(0x03);
+
+	memset((void*)&simSysTick, 0, sizeof(simSysTick));
+	InitRegister32(&simSysTick.CTRL, 0, 0, &WriteSysTickCTRL);
+	InitRegister32(&simSysTick.LOAD, 0, 0, 0);
+	InitRegister32(&simSysTick.VAL, 0, &ReadSysTickVAL, &WriteSysTickVAL);
+	sysTickEnabled = false;
+	sysTickPending = false;
+	sysTickReload = NEVER;
+
+	InitRegister32(&simSCB.ICSR, 0, &ReadICSR, 0);
+	simDWT.CTRL = 0;
+	InitRegister32(&simDWT.CYCCNT, 0, &ReadCYCCNT, 0);
+	memset((void*)&simCoreDebug, 0, sizeof(simCoreDebug));
+
+	memset(handlers, 0, sizeof(handlers));
+	handlers[SysTick_IRQn + 1] = SysTick_Handler;
+	void (*dmaHandlers[DMA_CHANNELS])(void) = {
+			DMA0_IRQHandler, DMA1_IRQHandler, DMA2_IRQHandler, DMA3_IRQHandler, DMA4_IRQHandler, DMA5_IRQHandler,
+			DMA6_IRQHandler, DMA7_IRQHandler, DMA8_IRQHandler, DMA9_IRQHandler, DMA10_IRQHandler, DMA11_IRQHandler,
+			DMA12_IRQHandler, DMA13_IRQHandler, DMA14_IRQHandler, DMA15_IRQHandler
+	};
+	for (uint8_t ch = 0; ch < DMA_CHANNELS; ch++)
+	{
+		handlers[DMA0_IRQn + ch + 1] = dmaHandlers[ch];
+	}
+	handlers[DMA_Error_IRQn + 1] = DMA_Error_IRQHandler;
+	handlers[PIT0_IRQn + 1] = PIT0_IRQHandler;
+	handlers[PIT1_IRQn + 1] = PIT1_IRQHandler;
+	handlers[PIT2_IRQn + 1] = PIT2_IRQHandler;
+	handlers[PIT3_IRQn + 1] = PIT3_IRQHandler;
+	void (*rxTxHandlers[SIM_UART_COUNT])(void) = {
+			UART0_RX_TX_IRQHandler, UART1_RX_TX_IRQHandler, UART2_RX_TX_IRQHandler,
+			UART3_RX_TX_IRQHandler, UART4_RX_TX_IRQHandler, UART5_RX_TX_IRQHandler
+	};
+	void (*errHandlers[SIM_UART_COUNT])(void) = {
+			UART0_ERR_IRQHandler, UART1_ERR_IRQHandler, UART2_ERR_IRQHandler,
+			UART3_ERR_IRQHandler, UART4_ERR_IRQHandler, UART5_ERR_IRQHandler
+	};
+	for (uint8_t n = 0; n < SIM_UART_COUNT; n++)
+	{
+		handlers[rxTxIRQs[n] + 1] = rxTxHandlers[n];
+		handlers[errIRQs[n] + 1] = errHandlers[n];
+	}
+}
+
+void Sim_Run(uint64_t cycles)
+{
+	uint64_t target = now + cycles;
+	Service();
+	while (1)
+	{
+		uint64_t next = NextEvent();
+		if (next > target)
+			break;
+		AdvanceTo(next);
+		ProcessEvents();
+		Service();
+	}
+	AdvanceTo(target);
+	Service();
+}
+
+uint64_t Sim_Now(void)
+{
+	return now;
+}
+
+uint32_t Sim_CharCycles(uint8_t uartNum)
+{
+	UART_Type* pUCR = &simUART[uartNum];
+	uint32_t sbr = ((pUCR->BDH.value & UART_BDH_SBR_MASK) << 8) | pUCR->BDL.value;
+	uint32_t brfa = pUCR->C4.value & UART_C4_BRFA_MASK;
+	uint32_t bits = 1 + ((pUCR->C1.value & UART_C1_M_MASK) ? 9 : 8) + 1;
+
+	// bits * 16 * (SBR + BRFA/32) module clocks, UART0 and UART1 run from the core clock and the rest from the bus
+	uint64_t moduleCycles = (uint64_t)bits * 16 * (32 * sbr + brfa);
+	uint64_t cycles = uartNum < 2 ? moduleCycles : BusToCore(moduleCycles);
+	cycles = (cycles + 16) / 32;
+	return cycles ? (uint32_t)cycles : 1;
+}
+
+void Sim_Connect(uint8_t from, uint8_t to)
+{
+	uarts[from].sinks |= 1u << to;
+}
+
+void Sim_Disconnect(uint8_t from)
+{
+	uarts[from].sinks = 0;
+}
+
+bool Sim_FeedWord(uint8_t uartNum, uint16_t word)
+{
+	SimUARTState* pState = &uarts[uartNum];
+	if (pState->feedHead - pState->feedTail == SIM_FEED_SIZE)
+		return false;
+
+	pState->feed[pState->feedHead % SIM_FEED_SIZE] = word;
+	pState->feedHead++;
+	if (!pState->feeding)
+	{
+		pState->feeding = true;
+		pState->feedStalled = false;
+		pState->feedAt = now + Sim_CharCycles(uartNum);
+		LineBusy(1u << uartNum);
+	}
+	return true;
+}
+
+bool Sim_Feed(uint8_t uartNum, const uint8_t* pData, uint16_t size)
+{
+	if (SIM_FEED_SIZE - Sim_FeedPending(uartNum) < size)
+		return false;
+	for (uint16_t i = 0; i < size; i++)
+	{
+		Sim_FeedWord(uartNum, pData[i]);
+	}
+	return true;
+}
+
+uint32_t Sim_FeedPending(uint8_t uartNum)
+{
+	return uarts[uartNum].feedHead - uarts[uartNum].feedTail;
+}
+
+uint32_t Sim_Captured(uint8_t uartNum, uint16_t* pWords, uint32_t maxCount)
+{
+	uint32_t count = uarts[uartNum].captured < maxCount ? uarts[uartNum].captured : maxCount;
+	if (pWords)
+		memcpy(pWords, uarts[uartNum].capture, count * sizeof(uint16_t));
+	return uarts[uartNum].captured;
+}
+
+void Sim_ClearCapture(uint8_t uartNum)
+{
+	uarts[uartNum].captured = 0;
+}
+
+int8_t Sim_DmaChannelFor(uint8_t requestSource)
+{
+	for (uint8_t ch = 0; ch < DMA_CHANNELS; ch++)
+	{
+		uint8_t chcfg = simDMAMUX.CHCFG[ch];
+		if ((chcfg & DMAMUX_CHCFG_ENBL_MASK) && (chcfg & DMAMUX_CHCFG_SOURCE_MASK) == (requestSource & DMAMUX_CHCFG_SOURCE_MASK))
+			return ch;
+	}
+	return -1;
+}
+
+void Sim_InjectDmaError(uint8_t channel)
+{
+	dmaPendingErrors |= 1u << channel;
+}
+
+const SimIRQStats* Sim_IRQStats(int irq)
+{
+	return &irqStats[irq + 1];
+}
+
+void Sim_ResetIRQStats(void)
+{
+	memset(irqStats, 0, sizeof(irqStats));
+}
+
+uint32_t Sim_Storms(void)
+{
+	return storms;
+}
+
+// Time stamp counter where there is one, nanoseconds elsewhere
+uint64_t Sim_HostCycles(void)
+{
+#ifdef __x86_64__
+	return __rdtsc();
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+#endif
+}
+
+void Sim_EnableIRQ(int irq)
+{
+	if (irq >= 0 && irq < IRQ_SLOTS)
+		nvicEnabled[irq] = true;
+	Service();
+}
+
+void Sim_DisableIRQ(int irq)
+{
+	if (irq >= 0 && irq < IRQ_SLOTS)
+		nvicEnabled[irq] = false;
+}
+
+uint32_t Sim_GetPrimask(void)
+{
+	return primask;
+}
+
+// Unmasking takes the interrupts that became pending meanwhile
+void Sim_SetPrimask(uint32_t value)
+{
+	primask = value & 1;
+	if (primask == 0)
+		Service();
+}
+
+/*******************************************************************************
+ *                                 GPIO
+ ******************************************************************************/
+
+// The pins are not modeled, the UART lines are joined with Sim_Connect
+void gpioMux(pin_t pin, uint8_t mux) { (void)pin; (void)mux; }
+void gpioMode(pin_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void gpioWrite(pin_t pin, bool value) { (void)pin; (void)value; }
+void gpioToggle(pin_t pin) { (void)pin; }
+bool gpioRead(pin_t pin) { (void)pin; return HIGH; }
@@ -0,0 +1,184 @@
+/***************************************************************************//**
+  @file     HardwareSim.h
+  @brief    Host model of the K64 UART, eDMA, PIT, SysTick and NVIC the drivers run against in the tests.
+            Include hardware.h, it pulls this in after the device header
+  @author   Group 2
+ ******************************************************************************/
+
+#ifndef HARDWARE_SIM_H_
+#define HARDWARE_SIM_H_
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define SIM_UART_COUNT		6
+#define SIM_CAPTURE_SIZE	65536u		// Transmitted characters kept per module
+#define SIM_FEED_SIZE		65536u		// Characters waiting to be fed per module
+#define SIM_STORM_LIMIT		1000u		// Calls to the same handler without time going by that count as a storm
+
+/*******************************************************************************
+ *                                OBJETOS
+ ******************************************************************************/
+
+// Peripheral register the model can watch. pRead replaces the stored value, pWrite runs after the store and may
+// act on it. Read-modify-write operators go through both, the way the core does a load and a store
+template <typename T>
+struct SimRegister
+{
+	T value;
+	T (*pRead)(uint8_t owner);
+	void (*pWrite)(uint8_t owner, T value);
+	uint8_t owner;
+
+	operator T() const { return pRead ? pRead(owner) : value; }
+	SimRegister& operator=(uint32_t newValue)
+	{
+		value = (T)newValue;
+		if (pWrite)
+			pWrite(owner, value);
+		return *this;
+	}
+	SimRegister& operator=(const SimRegister& other) { return *this = (uint32_t)(T)other; }
+	SimRegister& operator|=(uint32_t bits) { return *this = (uint32_t)(T)*this | bits; }
+	SimRegister& operator&=(uint32_t bits) { return *this = (uint32_t)(T)*this & bits; }
+	SimRegister& operator^=(uint32_t bits) { return *this = (uint32_t)(T)*this ^ bits; }
+};
+
+typedef SimRegister<uint8_t> SimReg8;
+typedef SimRegister<uint32_t> SimReg32;
+
+typedef struct
+{
+	SimReg8 BDH, BDL, C1, C2, S1, S2, C3, D, MA1, MA2, C4, C5, ED, MODEM, IR;
+	SimReg8 PFIFO, CFIFO, SFIFO, TWFIFO, TCFIFO, RWFIFO, RCFIFO;
+} UART_Type;
+
+typedef struct
+{
+	uint32_t SADDR;
+	uint16_t SOFF;
+	uint16_t ATTR;
+	uint32_t NBYTES_MLNO;
+	uint32_t SLAST;
+	uint32_t DADDR;
+	uint16_t DOFF;
+	uint16_t CITER_ELINKNO;
+	uint32_t DLAST_SGA;
+	uint16_t CSR;
+	uint16_t BITER_ELINKNO;
+} SimTCD;
+
+typedef struct
+{
+	uint32_t CR;
+	uint32_t ES;
+	uint32_t ERQ;
+	uint32_t EEI;
+	SimReg8 CEEI, SEEI, CERQ, SERQ, CDNE, SSRT, CERR, CINT;
+	uint32_t INT;
+	uint32_t ERR;
+	SimTCD TCD[16];
+} DMA_Type;
+
+typedef struct
+{
+	uint32_t MCR;
+	struct
+	{
+		uint32_t LDVAL;
+		SimReg32 CVAL;
+		SimReg32 TCTRL;
+		SimReg32 TFLG;
+	} CHANNEL[4];
+} PIT_Type;
+
+typedef struct
+{
+	SimReg32 CTRL, LOAD, VAL;
+	uint32_t CALIB;
+} SimSysTick_Type;
+
+typedef struct
+{
+	SimReg32 ICSR;
+} SimSCB_Type;
+
+typedef struct
+{
+	uint32_t CTRL;
+	SimReg32 CYCCNT;
+} SimDWT_Type;
+
+// Interrupts served by the model, with the host time spent in their handlers
+typedef struct
+{
+	uint32_t calls;
+	uint64_t hostCycles;	// Time stamp counter where there is one, nanoseconds elsewhere
+} SimIRQStats;
+
+/*******************************************************************************
+ *                                VARIABLES
+ ******************************************************************************/
+
+extern UART_Type simUART[SIM_UART_COUNT];
+extern DMA_Type simDMA;
+extern DMAMUX_Type simDMAMUX;
+extern PIT_Type simPIT;
+extern SIM_Type simSIM;
+extern SimSysTick_Type simSysTick;
+extern SimSCB_Type simSCB;
+extern SimDWT_Type simDWT;
+extern CoreDebug_Type simCoreDebug;
+
+/*******************************************************************************
+ *                               PROTOTIPOS
+ ******************************************************************************/
+
+// Power on state: registers cleared, clocks as hw_Init leaves them (core 100 MHz, bus 50 MHz), nothing connected
+void Sim_Reset(void);
+
+// Advances the simulated time by the given core cycles, running every interrupt and eDMA request on the way
+void Sim_Run(uint64_t cycles);
+uint64_t Sim_Now(void);
+// Core cycles one character takes on the module with its current divider and word length
+uint32_t Sim_CharCycles(uint8_t uartNum);
+
+// What the transmitter of from sends reaches the receiver of to. A transmitter can drive several receivers
+void Sim_Connect(uint8_t from, uint8_t to);
+void Sim_Disconnect(uint8_t from);
+// Queues characters for the receiver, back to back at its own rate. Held while its RTS is deasserted.
+// The ninth bit, if any, is bit 8 of each entry
+bool Sim_Feed(uint8_t uartNum, const uint8_t* pData, uint16_t size);
+bool Sim_FeedWord(uint8_t uartNum, uint16_t word);
+uint32_t Sim_FeedPending(uint8_t uartNum);
+
+// Characters the module transmitted so far, bit 8 is the ninth bit
+uint32_t Sim_Captured(uint8_t uartNum, uint16_t* pWords, uint32_t maxCount);
+void Sim_ClearCapture(uint8_t uartNum);
+
+// eDMA channel the DMAMUX routes the request source to, -1 if none
+int8_t Sim_DmaChannelFor(uint8_t requestSource);
+// Bus error on the channel's next access: the transfer stops where it is and the error interrupt is raised
+void Sim_InjectDmaError(uint8_t channel);
+
+// Calls and host time of the handler of an IRQn, SysTick_IRQn included
+const SimIRQStats* Sim_IRQStats(int irq);
+void Sim_ResetIRQStats(void);
+// Handlers that kept being called without time going by, a level interrupt nothing clears
+uint32_t Sim_Storms(void);
+
+uint64_t Sim_HostCycles(void);
+
+void Sim_EnableIRQ(int irq);
+void Sim_DisableIRQ(int irq);
+uint32_t Sim_GetPrimask(void);
+void Sim_SetPrimask(uint32_t primask);
+
+#endif /* HARDWARE_SIM_H_ */
@@ -0,0 +1,75 @@
+/***************************************************************************//**
+  @file     hardware.h
+  @brief    Host stand-in for the startup hardware.h, the peripherals the drivers use point at HardwareSim models
+  @author   Group 2
+ ******************************************************************************/
+
+#ifndef _HARDWARE_H_
+#define _HARDWARE_H_
+
+/*******************************************************************************
+ *                                ENCABEZADOS
+ ******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+// The device header declares its own register layouts under these names, the simulated ones take them over below
+#define UART_Type MK64F12_UART_Type
+#define DMA_Type MK64F12_DMA_Type
+#define PIT_Type MK64F12_PIT_Type
+#include "fsl_device_registers.h"
+#include "core_cm4.h"
+#undef UART_Type
+#undef DMA_Type
+#undef PIT_Type
+
+#include "HardwareSim.h"
+
+/*******************************************************************************
+ *                                MACROS
+ ******************************************************************************/
+
+#define __CORE_CLOCK__  100000000U
+#define __FOREVER__     for(;;)
+#define __ISR__         void
+
+#undef UART0
+#undef UART1
+#undef UART2
+#undef UART3
+#undef UART4
+#undef UART5
+#undef DMA0
+#undef DMAMUX
+#undef PIT
+#undef SIM
+#undef SysTick
+#undef SCB
+#undef DWT
+#undef CoreDebug
+#define UART0		(&simUART[0])
+#define UART1		(&simUART[1])
+#define UART2		(&simUART[2])
+#define UART3		(&simUART[3])
+#define UART4		(&simUART[4])
+#define UART5		(&simUART[5])
+#define DMA0		(&simDMA)
+#define DMAMUX		(&simDMAMUX)
+#define PIT			(&simPIT)
+#define SIM			(&simSIM)
+#define SysTick		(&simSysTick)
+#define SCB			(&simSCB)
+#define DWT			(&simDWT)
+#define CoreDebug	(&simCoreDebug)
+
+#undef NVIC_EnableIRQ
+#undef NVIC_DisableIRQ
+#define NVIC_EnableIRQ		Sim_EnableIRQ
+#define NVIC_DisableIRQ		Sim_DisableIRQ
+
+#define __get_PRIMASK()		Sim_GetPrimask()
+#define __set_PRIMASK(x)	Sim_SetPrimask(x)
+#define __disable_irq()		Sim_SetPrimask(1)
+#define __enable_irq()		Sim_SetPrimask(0)
+
+#endif /* _HARDWARE_H_ */